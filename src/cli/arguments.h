@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <sstream>
+
+#include <fmt/core.h>
+#include <glm/glm.hpp>
+
+#include <util/exception.h>
+
+namespace cr::cli
+{
+    /*
+     * Minimal "--key value" / "--flag" parser for the command line tools.
+     * Anything that isn't prefixed with "--" is treated as the value of the previous key.
+     */
+    class arguments
+    {
+    public:
+        arguments(int argc, char **argv)
+        {
+            for (auto i = 1; i < argc; i++)
+            {
+                const auto key = std::string_view(argv[i]);
+                if (key.rfind("--", 0) != 0)
+                    cr::exit(fmt::format("Unexpected argument [{}], expected \"--name\"", key));
+
+                auto value = std::string();
+                if (i + 1 < argc && std::string_view(argv[i + 1]).rfind("--", 0) != 0)
+                    value = argv[++i];
+
+                _values[std::string(key.substr(2))] = std::move(value);
+            }
+        }
+
+        [[nodiscard]] bool has(const std::string &key) const noexcept
+        {
+            return _values.find(key) != _values.end();
+        }
+
+        [[nodiscard]] std::string get(const std::string &key, const std::string &fallback) const
+        {
+            const auto it = _values.find(key);
+            return it == _values.end() ? fallback : it->second;
+        }
+
+        [[nodiscard]] std::string require(const std::string &key) const
+        {
+            const auto it = _values.find(key);
+            if (it == _values.end() || it->second.empty())
+                cr::exit(fmt::format("Missing required argument [--{}]", key));
+            return it->second;
+        }
+
+        template<typename T>
+        [[nodiscard]] T get_number(const std::string &key, T fallback) const
+        {
+            const auto it = _values.find(key);
+            if (it == _values.end()) return fallback;
+
+            auto stream = std::istringstream(it->second);
+            auto value  = T();
+            if (!(stream >> value))
+                cr::exit(fmt::format("Argument [--{}] expected a number, got [{}]", key, it->second));
+            return value;
+        }
+
+        // Parses "x,y,z"
+        [[nodiscard]] glm::vec3 get_vec3(const std::string &key, const glm::vec3 &fallback) const
+        {
+            const auto it = _values.find(key);
+            if (it == _values.end()) return fallback;
+
+            auto value     = glm::vec3();
+            auto separator = char();
+            auto stream    = std::istringstream(it->second);
+            if (!(stream >> value.x >> separator >> value.y >> separator >> value.z))
+                cr::exit(fmt::format("Argument [--{}] expected \"x,y,z\", got [{}]", key, it->second));
+            return value;
+        }
+
+        // Parses "WIDTHxHEIGHT"
+        [[nodiscard]] glm::ivec2 get_resolution(const std::string &key, const glm::ivec2 &fallback) const
+        {
+            const auto it = _values.find(key);
+            if (it == _values.end()) return fallback;
+
+            auto value     = glm::ivec2();
+            auto separator = char();
+            auto stream    = std::istringstream(it->second);
+            if (!(stream >> value.x >> separator >> value.y) || value.x <= 0 || value.y <= 0)
+                cr::exit(fmt::format("Argument [--{}] expected \"WxH\", got [{}]", key, it->second));
+            return value;
+        }
+
+    private:
+        std::unordered_map<std::string, std::string> _values;
+    };
+}    // namespace cr::cli
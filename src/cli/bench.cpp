@@ -0,0 +1,304 @@
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include <cli/arguments.h>
+#include <render/renderer.h>
+
+namespace
+{
+    void print_usage()
+    {
+        fmt::print(
+          "Usage: crender-bench [options]\n"
+          "\n"
+          "Renders a scene with very uneven per-pixel cost (a stack of glass panes over a\n"
+          "quarter of the frame, sky everywhere else) once with a row per task and once\n"
+          "with square tiles, both taking --tile-samples per task, then again with square\n"
+          "tiles on the wavefront integrator, and reports the throughput of each.\n"
+          "\n"
+          "With --sampling it instead compares how fast the estimate of light reflected off a\n"
+          "rough metal converges when its directions are picked the way the renderer picks\n"
+          "them, cosine weighted or uniformly over the hemisphere.\n"
+          "\n"
+          "  --resolution <WxH>      Resolution (default 512x512)\n"
+          "  --spp <count>           Samples per pixel for each run (default 16)\n"
+          "  --bounces <count>       Max bounces per path (default 16)\n"
+          "  --threads <count>       Worker threads (default hardware concurrency)\n"
+          "  --panes <count>         Glass panes in the stack (default 24)\n"
+          "  --tile-size <WxH>       Tile size to compare against rows (default 32x32)\n"
+          "  --tile-samples <count>  Samples a row or tile takes per task (default 4)\n"
+          "  --embree-config <config> Embree device config, e.g. \"threads=8,hugepages=1\"\n"
+          "  --sampling              Compare BSDF sampling strategies instead\n"
+          "  --trials <count>        Renders of --spp samples per strategy (default 1024)\n");
+    }
+
+    // Stack of glass quads in front of the camera, covering the left quarter of the frame
+    [[nodiscard]] cr::asset_loader::model_data glass_stack(int panes)
+    {
+        auto data = cr::asset_loader::model_data();
+        data.name = "glass-stack";
+
+        auto glass       = cr::material::information();
+        glass.name       = "glass";
+        glass.shade_type = cr::material::glass;
+        glass.ior        = 1.5f;
+        data.materials.emplace_back(glass);
+
+        data.texture_coords = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+        data.normals        = { { 0, 0, -1 } };
+
+        constexpr auto quad = std::array<uint32_t, 6>({ 0, 1, 2, 0, 2, 3 });
+
+        for (auto i = 0; i < panes; i++)
+        {
+            const auto z     = 2.0f + i * 0.05f;
+            const auto first = static_cast<uint32_t>(data.vertices.size());
+
+            data.vertices.emplace_back(-2.0f, -2.0f, z);
+            data.vertices.emplace_back(-0.5f, -2.0f, z);
+            data.vertices.emplace_back(-0.5f, 2.0f, z);
+            data.vertices.emplace_back(-2.0f, 2.0f, z);
+
+            for (const auto corner : quad)
+            {
+                data.vertex_indices.push_back(first + corner);
+                data.texture_indices.push_back(corner);
+                data.normal_indices.push_back(0);
+            }
+
+            data.material_indices.push_back(0);
+            data.material_indices.push_back(0);
+        }
+
+        return data;
+    }
+
+    struct run_result
+    {
+        double   seconds;
+        uint64_t rays;
+    };
+
+    [[nodiscard]] run_result
+      run(cr::renderer &            renderer,
+          cr::renderer::integrator integrator,
+          const glm::ivec2 &        tile_size,
+          uint64_t                  tile_samples,
+          uint64_t                  spp)
+    {
+        renderer.update(
+          [&renderer, integrator, tile_size, tile_samples, spp]
+          {
+              renderer.set_integrator(integrator);
+              renderer.set_tile_size(tile_size.x, tile_size.y);
+              renderer.set_tile_samples(tile_samples);
+              renderer.set_target_spp(spp);
+          });
+
+        auto timer = cr::timer();
+        while (renderer.current_sample_count() < spp)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        return { timer.time_since_start(), renderer.current_stats().total_rays };
+    }
+
+    struct strategy
+    {
+        const char *name;
+
+        // One estimate of the reflected light, BSDF times the cosine over the pdf under a sky
+        // that's white everywhere
+        std::function<float(const glm::vec3 &, float, const glm::vec2 &)> estimate;
+    };
+
+    [[nodiscard]] std::array<strategy, 3> sampling_strategies()
+    {
+        constexpr auto normal = glm::vec3(0.0f, 1.0f, 0.0f);
+        constexpr auto f0     = glm::vec3(0.9f);
+
+        const auto evaluate =
+          [normal, f0](const glm::vec3 &view, float roughness, const glm::vec3 &light)
+        { return cr::brdf::ggx(view, light, normal, roughness, f0).x; };
+
+        return { {
+          { "ggx",
+            [normal, f0](const glm::vec3 &view, float roughness, const glm::vec2 &uv)
+            { return cr::brdf::sample_ggx(view, normal, roughness, f0, uv).weight.x; } },
+          { "cosine",
+            [normal, evaluate](const glm::vec3 &view, float roughness, const glm::vec2 &uv)
+            {
+                // The way smooth surfaces pick their directions
+                const auto light = glm::normalize(cr::sampling::hemp_cos(normal, uv));
+                const auto pdf   = cr::sampling::hemp_cos_pdf(glm::dot(normal, light));
+                return pdf > 0.0f ? evaluate(view, roughness, light) / pdf : 0.0f;
+            } },
+          { "uniform",
+            [evaluate](const glm::vec3 &view, float roughness, const glm::vec2 &uv)
+            {
+                auto light = cr::sampling::sphere(uv);
+                light.y    = glm::abs(light.y);
+                return evaluate(view, roughness, light) * cr::numbers<float>::tau;
+            } },
+        } };
+    }
+
+    // Variance of a single sample and the RMS error of the mean of spp of them, per strategy
+    void compare_sampling(uint64_t spp, uint64_t trials)
+    {
+        const auto strategies = ::sampling_strategies();
+
+        auto       random  = std::mt19937(1);
+        auto       uniform = std::uniform_real_distribution<float>(0.0f, 1.0f);
+        const auto next    = [&random, &uniform]
+        { return glm::vec2(uniform(random), uniform(random)); };
+
+        fmt::print(
+          "Reflected light off a metal under a white sky, [{}] spp, [{}] trials\n",
+          spp,
+          trials);
+        fmt::print(
+          "{:<10} {:<6} {:<8} {:>10} {:>12} {:>12} {:>14}\n",
+          "roughness",
+          "view",
+          "strategy",
+          "mean",
+          "variance",
+          "rmse",
+          "variance / ggx");
+
+        for (const auto roughness : { 0.2f, 0.35f, 0.5f, 0.65f, 0.8f, 1.0f })
+            for (const auto angle : { 0.3f, 1.2f })
+            {
+                const auto view = glm::vec3(glm::sin(angle), glm::cos(angle), 0.0f);
+
+                // Converged with the renderer's own strategy, to measure the errors against
+                auto       reference         = 0.0;
+                const auto reference_samples = spp * trials * 4;
+                for (auto i = uint64_t(0); i < reference_samples; i++)
+                    reference += strategies[0].estimate(view, roughness, next());
+                reference /= static_cast<double>(reference_samples);
+
+                auto ggx_variance = 0.0;
+                for (const auto &strategy : strategies)
+                {
+                    auto sum     = 0.0;
+                    auto squares = 0.0;
+                    auto error   = 0.0;
+                    for (auto trial = uint64_t(0); trial < trials; trial++)
+                    {
+                        auto trial_sum = 0.0;
+                        for (auto i = uint64_t(0); i < spp; i++)
+                        {
+                            const auto value =
+                              static_cast<double>(strategy.estimate(view, roughness, next()));
+                            trial_sum += value;
+                            squares += value * value;
+                        }
+                        sum += trial_sum;
+
+                        const auto deviation = trial_sum / static_cast<double>(spp) - reference;
+                        error += deviation * deviation;
+                    }
+
+                    const auto count    = static_cast<double>(spp * trials);
+                    const auto mean     = sum / count;
+                    const auto variance = squares / count - mean * mean;
+                    if (&strategy == &strategies[0]) ggx_variance = variance;
+
+                    fmt::print(
+                      "{:<10.2f} {:<6.2f} {:<8} {:>10.4f} {:>12.5f} {:>12.5f} {:>13.1f}x\n",
+                      roughness,
+                      angle,
+                      strategy.name,
+                      mean,
+                      variance,
+                      std::sqrt(error / static_cast<double>(trials)),
+                      variance / glm::max(ggx_variance, 1e-12));
+                }
+            }
+    }
+
+    void report(const std::string &name, const run_result &result)
+    {
+        fmt::print(
+          "{:<16} {:>10.3f}s {:>14} rays {:>10.3f} Mrays/s\n",
+          name,
+          result.seconds,
+          result.rays,
+          result.rays / result.seconds / 1'000'000.0);
+    }
+}    // namespace
+
+int main(int argc, char **argv)
+{
+    const auto args = cr::cli::arguments(argc, argv);
+
+    if (args.has("help"))
+    {
+        print_usage();
+        return 0;
+    }
+
+    if (args.has("sampling"))
+    {
+        ::compare_sampling(
+          args.get_number<uint64_t>("spp", 16),
+          args.get_number<uint64_t>("trials", 1024));
+        return 0;
+    }
+
+    const auto hardware_threads = std::thread::hardware_concurrency();
+
+    const auto resolution   = args.get_resolution("resolution", { 512, 512 });
+    const auto spp          = args.get_number<uint64_t>("spp", 16);
+    const auto bounces      = args.get_number<uint64_t>("bounces", 16);
+    const auto panes        = args.get_number<int>("panes", 24);
+    const auto tile_size    = args.get_resolution("tile-size", { 32, 32 });
+    const auto tile_samples = args.get_number<uint64_t>("tile-samples", 4);
+    const auto thread_count = args.get_number<uint32_t>(
+      "threads",
+      hardware_threads == 0 ? 1 : hardware_threads);
+
+    auto thread_pool = std::make_unique<cr::thread_pool>(thread_count);
+    auto scene       = std::make_unique<cr::scene>(args.get("embree-config", ""));
+
+    scene->add_model(::glass_stack(panes));
+
+    auto camera      = scene->registry()->camera();
+    camera->position = glm::vec3(0.0f, 0.0f, 0.0f);
+    camera->rotate(glm::vec3(0.0f));
+
+    auto renderer =
+      std::make_unique<cr::renderer>(resolution.x, resolution.y, bounces, &thread_pool, &scene);
+
+    fmt::print(
+      "Resolution [{}x{}], [{}] spp, [{}] bounces, [{}] threads, [{}] panes\n",
+      resolution.x,
+      resolution.y,
+      spp,
+      bounces,
+      thread_pool->thread_count(),
+      panes);
+
+    // Warm up caches and the BVH before timing anything
+    static_cast<void>(::run(*renderer, cr::renderer::integrator::path, tile_size, 1, 1));
+
+    // Same samples per task for both, so the speedup is down to the shape of the work alone
+    const auto rows = ::run(
+      *renderer,
+      cr::renderer::integrator::path,
+      glm::ivec2(resolution.x, 1),
+      tile_samples,
+      spp);
+    const auto tiles =
+      ::run(*renderer, cr::renderer::integrator::path, tile_size, tile_samples, spp);
+    const auto wavefront =
+      ::run(*renderer, cr::renderer::integrator::wavefront, tile_size, tile_samples, spp);
+
+    ::report("Rows", rows);
+    ::report(fmt::format("Tiles {}x{}", tile_size.x, tile_size.y), tiles);
+    ::report("Wavefront", wavefront);
+    fmt::print("Speedup: [{:.2f}x]\n", rows.seconds / tiles.seconds);
+    fmt::print("Wavefront speedup: [{:.2f}x]\n", tiles.seconds / wavefront.seconds);
+}
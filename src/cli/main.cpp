@@ -0,0 +1,348 @@
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <filesystem>
+
+#include <cli/arguments.h>
+#include <render/renderer.h>
+#include <util/asset_loader.h>
+#include <util/denoise.h>
+#include <util/logger.h>
+
+namespace
+{
+    volatile std::sig_atomic_t stop_requested = 0;
+
+    void request_stop(int)
+    {
+        stop_requested = 1;
+    }
+
+    void print_usage()
+    {
+        fmt::print(
+          "Usage: crender-cli --model <file.obj> [options]\n"
+          "\n"
+          "  --model <path>             OBJ file to render (required)\n"
+          "  --skybox <path>            EXR / HDR / PNG / JPG skybox\n"
+          "  --skybox-rotation <x,y>    Skybox rotation in degrees\n"
+          "  --resolution <WxH>         Output resolution (default 1024x1024)\n"
+          "  --spp <count>              Samples per pixel, 0 for no limit (default 64, or 0 when\n"
+          "                             a time or error budget is given)\n"
+          "  --time-budget <s>          Stop after this many seconds (default 0, no limit)\n"
+          "  --error-budget <e>         Stop once the mean relative error is below this (default 0)\n"
+          "  --first-sample <index>     Render samples [index, index + spp), see crender-merge\n"
+          "  --region <x,y,w,h>         Only render this rectangle of pixels, see crender-merge\n"
+          "  --bounces <count>          Max bounces per path (default 5)\n"
+          "  --threads <count>          Worker threads (default hardware concurrency)\n"
+          "  --tile-size <WxH>          Pixels per scheduled tile (default 32x32)\n"
+          "  --tile-samples <count>     Samples a tile takes per task (default 4)\n"
+          "  --integrator <type>        path or wavefront (default path)\n"
+          "  --sampler <type>           random, sobol or blue-noise (default sobol)\n"
+          "  --adaptive-threshold <e>   Retire tiles below this relative error (default 0, off)\n"
+          "  --adaptive-min-spp <count> Samples before a tile can retire (default 16)\n"
+          "  --roulette-depth <count>   Bounces before Russian roulette can end a path (default 3)\n"
+          "  --no-roulette              Disable Russian roulette\n"
+          "  --profile                  Time tracing, shading and accumulation separately\n"
+          "  --metrics <path>           Keep writing render metrics to this file\n"
+          "  --metrics-format <type>    openmetrics or json (default openmetrics)\n"
+          "  --metrics-interval <s>     Seconds between metrics writes (default 5)\n"
+          "  --checkpoint <path>        Keep saving the render here, and on SIGTERM\n"
+          "  --checkpoint-interval <s>  Seconds between checkpoints (default 300)\n"
+          "  --compress-checkpoint      Deflate checkpoints, slower to write but about half the size\n"
+          "  --resume                   Carry on from --checkpoint if it exists\n"
+          "  --embree-config <config>   Embree device config, e.g. \"threads=8,hugepages=1,isa=avx2\"\n"
+          "  --camera-position <x,y,z>  Camera position\n"
+          "  --camera-rotation <x,y,z>  Camera rotation in degrees\n"
+          "  --fov <degrees>            Camera field of view (default 75)\n"
+          "  --no-sun                   Disable the sun\n"
+          "  --denoise                  Also export a denoised image\n"
+          "  --error-map                Also export the per pixel relative error as EXR\n"
+          "  --output <name>            Output name, relative to ./out/ (default \"render\")\n"
+          "  --format <type>            png, jpg, exr or hdr (default png)\n");
+    }
+
+    void flush_log()
+    {
+        static auto messages = std::vector<std::string>();
+        cr::logger::read_messages(messages);
+        for (const auto &message : messages) fmt::print("{}\n", message);
+        messages.clear();
+    }
+
+    void write_metrics(cr::renderer &renderer, const std::string &path, const std::string &format)
+    {
+        const auto stats  = renderer.current_stats();
+        const auto eta    = renderer.current_eta();
+        auto       gauges = std::vector<cr::metrics::gauge>({
+          { "samples", "Samples every pixel has reached",
+            static_cast<double>(renderer.current_sample_count()) },
+          { "average_samples", "Average samples per pixel", stats.average_samples },
+          { "retired_tiles", "Tiles adaptive sampling has retired",
+            static_cast<double>(stats.retired_tiles) },
+          { "rays_per_second", "Rays traced per second",
+            static_cast<double>(stats.rays_per_second) },
+          { "running_time_seconds", "Seconds since the render started", stats.running_time },
+        });
+
+        // Neither format has a portable infinity, an unknown estimate is left out instead
+        if (std::isfinite(eta.error))
+            gauges.push_back({ "estimated_error", "Mean relative error of the image",
+                               static_cast<double>(eta.error) });
+        if (std::isfinite(eta.seconds))
+            gauges.push_back({ "eta_seconds", "Seconds until the render budget runs out",
+                               eta.seconds });
+
+        cr::metrics::write_file(
+          path,
+          format == "json" ? cr::metrics::to_json(stats.counters, gauges)
+                           : cr::metrics::to_openmetrics(stats.counters, gauges));
+    }
+
+    // Parses "x,y,w,h" into the region's min and max, the whole image if it isn't given
+    [[nodiscard]] std::pair<glm::ivec2, glm::ivec2> parse_region(const cr::cli::arguments &args)
+    {
+        if (!args.has("region")) return { glm::ivec2(0), glm::ivec2(0) };
+
+        const auto value     = args.require("region");
+        auto       min       = glm::ivec2();
+        auto       size      = glm::ivec2();
+        auto       separator = char();
+        auto       stream    = std::istringstream(value);
+        stream >> min.x >> separator >> min.y >> separator >> size.x >> separator >> size.y;
+        if (!stream || min.x < 0 || min.y < 0 || size.x <= 0 || size.y <= 0)
+            cr::exit(fmt::format("Argument [--region] expected \"x,y,w,h\", got [{}]", value));
+
+        return { min, min + size };
+    }
+
+    [[nodiscard]] cr::asset_loader::image_type parse_image_type(const std::string &name)
+    {
+        if (name == "png") return cr::asset_loader::image_type::PNG;
+        if (name == "jpg") return cr::asset_loader::image_type::JPG;
+        if (name == "exr") return cr::asset_loader::image_type::EXR;
+        if (name == "hdr") return cr::asset_loader::image_type::HDR;
+
+        cr::exit(fmt::format("Unknown output format [{}]", name));
+        return cr::asset_loader::image_type::PNG;
+    }
+
+    [[nodiscard]] cr::renderer::integrator parse_integrator(const std::string &name)
+    {
+        if (name == "path") return cr::renderer::integrator::path;
+        if (name == "wavefront") return cr::renderer::integrator::wavefront;
+
+        cr::exit(fmt::format("Unknown integrator [{}]", name));
+        return cr::renderer::integrator::path;
+    }
+
+    [[nodiscard]] cr::sampler::type parse_sampler(const std::string &name)
+    {
+        if (name == "random") return cr::sampler::type::random;
+        if (name == "sobol") return cr::sampler::type::sobol;
+        if (name == "blue-noise") return cr::sampler::type::blue_noise;
+
+        cr::exit(fmt::format("Unknown sampler [{}]", name));
+        return cr::sampler::type::sobol;
+    }
+}    // namespace
+
+int main(int argc, char **argv)
+{
+    const auto args = cr::cli::arguments(argc, argv);
+
+    if (args.has("help") || !args.has("model"))
+    {
+        print_usage();
+        return args.has("help") ? 0 : 1;
+    }
+
+    const auto hardware_threads = std::thread::hardware_concurrency();
+
+    const auto resolution   = args.get_resolution("resolution", { 1024, 1024 });
+    const auto time_budget  = args.get_number<double>("time-budget", 0.0);
+    const auto error_budget = args.get_number<float>("error-budget", 0.0f);
+    const auto bounces      = args.get_number<uint64_t>("bounces", 5);
+    const auto thread_count = args.get_number<uint32_t>(
+      "threads",
+      hardware_threads == 0 ? 1 : hardware_threads);
+    const auto output      = args.get("output", "render");
+    const auto output_type = ::parse_image_type(args.get("format", "png"));
+
+    // A time or error budget alone decides when to stop, a sample limit would cut it short
+    const auto has_budget = time_budget > 0.0 || error_budget > 0.0f;
+    const auto spp        = args.get_number<uint64_t>("spp", has_budget ? 0 : 64);
+    if (spp == 0 && !has_budget)
+        cr::exit("--spp 0 never stops without a --time-budget or --error-budget");
+
+    const auto budget = cr::renderer::render_budget { time_budget, spp, error_budget };
+
+    auto thread_pool = std::make_unique<cr::thread_pool>(thread_count);
+    auto scene       = std::make_unique<cr::scene>(args.get("embree-config", ""));
+
+    {
+        const auto model_path = std::filesystem::path(args.require("model"));
+        cr::logger::info("Starting to load model [{}]", model_path.string());
+        auto timer = cr::timer();
+
+        const auto model_data =
+          cr::asset_loader::load_model(model_path.string(), model_path.parent_path().string());
+        scene->add_model(model_data);
+
+        cr::logger::info("Finished loading model in [{}s]", timer.time_since_start());
+    }
+
+    if (args.has("skybox"))
+    {
+        const auto skybox_path = args.require("skybox");
+        cr::logger::info("Started to load skybox [{}]", skybox_path);
+        auto timer = cr::timer();
+
+        auto image = cr::asset_loader::load_picture(skybox_path);
+        if (image.colour.empty()) cr::exit(fmt::format("Failed to load skybox [{}]", skybox_path));
+        scene->set_skybox(image.as_image());
+
+        const auto rotation = args.get_vec3("skybox-rotation", glm::vec3());
+        scene->set_skybox_rotation(glm::vec2(rotation) / 360.f);
+
+        cr::logger::info("Finished loading skybox in [{}s]", timer.time_since_start());
+    }
+
+    scene->set_sun_enabled(!args.has("no-sun"));
+
+    {
+        auto camera      = scene->registry()->camera();
+        camera->fov      = args.get_number<float>("fov", camera->fov);
+        camera->position = args.get_vec3("camera-position", camera->position);
+        camera->rotate(args.get_vec3("camera-rotation", glm::vec3()));
+    }
+
+    ::flush_log();
+
+    auto renderer =
+      std::make_unique<cr::renderer>(resolution.x, resolution.y, bounces, &thread_pool, &scene);
+    renderer->update(
+      [&renderer, &args, &budget]
+      {
+          const auto tile_size = args.get_resolution("tile-size", { 32, 32 });
+          renderer->set_tile_size(tile_size.x, tile_size.y);
+          renderer->set_tile_samples(args.get_number<uint64_t>("tile-samples", 4));
+          renderer->set_integrator(::parse_integrator(args.get("integrator", "path")));
+          renderer->set_sampler(::parse_sampler(args.get("sampler", "sobol")));
+          renderer->set_adaptive_sampling(
+            args.get_number<float>("adaptive-threshold", 0.0f),
+            args.get_number<uint64_t>("adaptive-min-spp", 16));
+          renderer->set_russian_roulette(
+            !args.has("no-roulette"),
+            args.get_number<int>("roulette-depth", 3));
+          renderer->set_profiling(args.has("profile"));
+          renderer->set_aov_enabled(cr::aov::albedo, args.has("denoise"));
+          renderer->set_aov_enabled(cr::aov::normals, args.has("denoise"));
+          renderer->set_aov_enabled(cr::aov::error, args.has("error-map"));
+          renderer->set_budget(budget);
+
+          // Partial renders of one frame, the raw sums go into the checkpoint for crender-merge
+          const auto [region_min, region_max] = ::parse_region(args);
+          renderer->set_region(region_min, region_max);
+          renderer->set_sample_range(args.get_number<uint64_t>("first-sample", 0), budget.samples);
+          if ((args.has("first-sample") || args.has("region")) && args.has("adaptive-threshold"))
+              cr::logger::warn("Adaptive sampling decides per render, merging won't be exact");
+      });
+
+    const auto metrics_path     = args.get("metrics", "");
+    const auto metrics_format   = args.get("metrics-format", "openmetrics");
+    const auto metrics_interval = args.get_number<double>("metrics-interval", 5.0);
+    if (metrics_format != "openmetrics" && metrics_format != "json")
+        cr::exit(fmt::format("Unknown metrics format [{}]", metrics_format));
+
+    const auto checkpoint_path     = args.get("checkpoint", "");
+    const auto checkpoint_interval = args.get_number<double>("checkpoint-interval", 300.0);
+    const auto compress_checkpoint = args.has("compress-checkpoint");
+    if (!checkpoint_path.empty())
+    {
+        // Preempted nodes get a SIGTERM and a short grace period, enough to save one last time
+        std::signal(SIGTERM, ::request_stop);
+
+        if (args.has("resume") && std::filesystem::exists(checkpoint_path) &&
+            !renderer->load_checkpoint(checkpoint_path))
+            cr::exit(fmt::format("Can't resume from [{}]", checkpoint_path));
+    }
+    else if (args.has("resume"))
+        cr::exit("--resume needs a --checkpoint to resume from");
+
+    auto metrics_timer    = cr::timer();
+    auto checkpoint_timer = cr::timer();
+    while (!renderer->finished() && !::stop_requested)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        ::flush_log();
+
+        const auto eta = renderer->current_eta();
+        fmt::print(
+          "Sample [{}/{}], error [{:.4f}], ETA [{:.1f}s] ({})\n",
+          renderer->current_sample_count(),
+          spp == 0 ? std::string("-") : std::to_string(spp),
+          eta.error,
+          eta.seconds,
+          cr::renderer::render_eta::name(eta.limiting));
+
+        if (!metrics_path.empty() && metrics_timer.time_since_start() >= metrics_interval)
+        {
+            ::write_metrics(*renderer, metrics_path, metrics_format);
+            metrics_timer.reset();
+        }
+
+        if (!checkpoint_path.empty() && checkpoint_timer.time_since_start() >= checkpoint_interval)
+        {
+            renderer->save_checkpoint(checkpoint_path, compress_checkpoint);
+            checkpoint_timer.reset();
+        }
+    }
+    if (!metrics_path.empty()) ::write_metrics(*renderer, metrics_path, metrics_format);
+
+    // Also kept once finished, a later run with a higher budget can carry on from it
+    if (!checkpoint_path.empty()) renderer->save_checkpoint(checkpoint_path, compress_checkpoint);
+
+    if (::stop_requested)
+    {
+        cr::logger::info("Stopped by SIGTERM");
+        ::flush_log();
+        return 128 + SIGTERM;
+    }
+
+    const auto stats = renderer->current_stats();
+    cr::logger::info(
+      "Rendered [{}] samples in [{}s], [{}] rays per second",
+      renderer->current_sample_count(),
+      stats.running_time,
+      stats.rays_per_second);
+    cr::logger::info(
+      "Average [{:.1f}] samples per pixel, [{}] tiles retired early",
+      stats.average_samples,
+      stats.retired_tiles);
+    cr::logger::info(
+      "[{}] paths ended by Russian roulette",
+      stats.counters[cr::metrics::counter::roulette_kills]);
+
+    std::filesystem::create_directories(std::filesystem::path("./out/" + output).parent_path());
+
+    const auto frame = renderer->snapshot();
+    cr::asset_loader::export_framebuffer(frame->colour, output, output_type);
+
+    if (args.has("denoise"))
+    {
+        const auto denoised =
+          cr::denoise(&frame->colour, &frame->normals, &frame->albedo, output_type);
+
+        cr::asset_loader::export_framebuffer(denoised, output + "-denoised", output_type);
+    }
+
+    if (args.has("error-map"))
+        cr::asset_loader::export_framebuffer(
+          frame->error,
+          output + "-error",
+          cr::asset_loader::image_type::EXR);
+
+    cr::logger::info("Exported [{}]", output);
+    ::flush_log();
+}
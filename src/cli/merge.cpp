@@ -0,0 +1,164 @@
+#include <filesystem>
+
+#include <cli/arguments.h>
+#include <render/renderer.h>
+#include <render/checkpoint.h>
+#include <util/asset_loader.h>
+#include <util/logger.h>
+
+namespace
+{
+    void print_usage()
+    {
+        fmt::print(
+          "Usage: crender-merge --inputs <a,b,...> [options]\n"
+          "\n"
+          "Sums the raw output of partial renders of one frame, each made with crender-cli\n"
+          "--checkpoint and a disjoint --first-sample range or --region, and resolves the image\n"
+          "a single render over all of them would have made.\n"
+          "\n"
+          "  --inputs <a,b,...>   Checkpoints of the partial renders (required)\n"
+          "  --reference <path>   Checkpoint of a single render to compare the merge against\n"
+          "  --output <name>      Output name, relative to ./out/ (default \"merged\")\n"
+          "  --format <type>      png, jpg, exr or hdr (default png)\n");
+    }
+
+    void flush_log()
+    {
+        static auto messages = std::vector<std::string>();
+        cr::logger::read_messages(messages);
+        for (const auto &message : messages) fmt::print("{}\n", message);
+        messages.clear();
+    }
+
+    [[nodiscard]] std::vector<std::string> split(const std::string &list)
+    {
+        auto out   = std::vector<std::string>();
+        auto start = size_t(0);
+        while (start <= list.size())
+        {
+            const auto end = std::min(list.find(',', start), list.size());
+            if (end > start) out.push_back(list.substr(start, end - start));
+            start = end + 1;
+        }
+        return out;
+    }
+
+    [[nodiscard]] cr::checkpoint::state load(const std::string &path)
+    {
+        auto checkpoint = cr::checkpoint::read(path);
+        if (!checkpoint)
+        {
+            ::flush_log();
+            cr::exit(fmt::format("Can't read [{}]", path));
+        }
+        return std::move(*checkpoint);
+    }
+
+    [[nodiscard]] cr::asset_loader::image_type parse_image_type(const std::string &name)
+    {
+        if (name == "png") return cr::asset_loader::image_type::PNG;
+        if (name == "jpg") return cr::asset_loader::image_type::JPG;
+        if (name == "exr") return cr::asset_loader::image_type::EXR;
+        if (name == "hdr") return cr::asset_loader::image_type::HDR;
+
+        cr::exit(fmt::format("Unknown output format [{}]", name));
+        return cr::asset_loader::image_type::PNG;
+    }
+}    // namespace
+
+int main(int argc, char **argv)
+{
+    const auto args = cr::cli::arguments(argc, argv);
+
+    if (args.has("help") || !args.has("inputs"))
+    {
+        print_usage();
+        return args.has("help") ? 0 : 1;
+    }
+
+    const auto inputs      = ::split(args.require("inputs"));
+    const auto output      = args.get("output", "merged");
+    const auto output_type = ::parse_image_type(args.get("format", "png"));
+    if (inputs.empty()) cr::exit("--inputs needs at least one checkpoint");
+
+    auto merged = ::load(inputs.front());
+    for (auto i = size_t(1); i < inputs.size(); i++)
+    {
+        const auto partial = ::load(inputs[i]);
+        if (!cr::checkpoint::merge(merged, partial))
+            cr::exit(fmt::format("[{}] is a render of a different frame", inputs[i]));
+
+        // Overlap isn't wrong, the extra samples are averaged in like any others, but it's
+        // no longer what one render would have made
+        if (partial.first_sample == merged.first_sample &&
+            partial.region_min == merged.region_min && partial.region_max == merged.region_max)
+            cr::logger::warn(
+              "[{}] covers the same samples as [{}]",
+              inputs[i],
+              inputs.front());
+    }
+
+    auto fewest = std::numeric_limits<float>::max();
+    auto most   = 0.0f;
+    for (auto p = size_t(3); p < merged.raw.size(); p += 4)
+    {
+        fewest = std::min(fewest, merged.raw[p]);
+        most   = std::max(most, merged.raw[p]);
+    }
+    cr::logger::info(
+      "Merged [{}] partial renders, [{}] to [{}] samples per pixel, [{:.1f}]s of rendering",
+      inputs.size(),
+      fewest,
+      most,
+      merged.elapsed);
+
+    auto matches_reference = true;
+    if (args.has("reference"))
+    {
+        const auto reference = ::load(args.require("reference"));
+        if (reference.fingerprint != merged.fingerprint ||
+            reference.raw.size() != merged.raw.size())
+            cr::exit("The reference is a render of a different frame");
+
+        // Partial sums are added in a different order than one render adds its samples, so
+        // the sums can differ by float rounding, the sample counts can't
+        auto counts_match = true;
+        auto largest      = 0.0f;
+        for (auto p = size_t(0); p < merged.raw.size(); p++)
+        {
+            if (p % 4 == 3)
+            {
+                counts_match = counts_match && merged.raw[p] == reference.raw[p];
+                continue;
+            }
+
+            const auto difference = std::abs(merged.raw[p] - reference.raw[p]);
+            const auto magnitude  = std::max(std::abs(reference.raw[p]), 1e-6f);
+            largest               = std::max(largest, difference / magnitude);
+        }
+
+        cr::logger::info(
+          "Largest relative difference to the reference [{}], sample counts [{}]",
+          largest,
+          counts_match ? "match" : "differ");
+        if (!counts_match)
+            cr::logger::error("The partial renders don't cover the samples of the reference");
+        matches_reference = counts_match;
+    }
+
+    auto image = cr::image(merged.width, merged.height);
+    for (auto y = uint64_t(0); y < merged.height; y++)
+        cr::renderer::resolve(
+          merged.raw.data() + y * merged.width * 4,
+          merged.width,
+          image.data() + y * merged.width * 4);
+
+    std::filesystem::create_directories(std::filesystem::path("./out/" + output).parent_path());
+    cr::asset_loader::export_framebuffer(image, output, output_type);
+
+    cr::logger::info("Exported [{}]", output);
+    ::flush_log();
+
+    return matches_reference ? 0 : 1;
+}
@@ -8,6 +8,7 @@ int main()
     auto scene = std::make_unique<cr::scene>();
 
     auto renderer = std::make_unique<cr::renderer>(1024, 1024, 5, &thread_pool, &scene);
+    renderer->set_progressive_preview(true);
     auto main_display = cr::display();
 
     auto post_processor = std::make_unique<cr::post_processor>();
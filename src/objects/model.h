@@ -21,17 +21,13 @@ namespace cr
 {
     namespace model
     {
+        // Builds the model's own BVH on the scene's device, it gets instanced into the top level
         [[nodiscard]] cr::entity::embree_ctx instance_geometry(
+          RTCDevice                     device,
           const std::vector<glm::vec3> &vertices,
           const std::vector<uint32_t> & indices,
           const std::vector<glm::vec2> &tex_coords);
 
-        [[nodiscard]] cr::ray::intersection_record intersect(
-          const cr::ray &                    ray,
-          const cr::entity::instances &      instances,
-          const cr::entity::embree_ctx & geometry,
-          const cr::entity::model_materials &u);
-
     }    // namespace model
 
 }    // namespace cr
@@ -2,21 +2,76 @@
 
 cr::thread_pool::thread_pool(uint32_t thread_count)
 {
+    thread_count = std::max(thread_count, 1u);
+
+    _queues.reserve(thread_count);
+    for (auto i = 0; i < thread_count; i++) _queues.push_back(std::make_unique<worker_queue>());
+
     _threads.reserve(thread_count);
     for (auto i = 0; i < thread_count; i++)
     {
-        _threads.emplace_back([this] {
-            while (_should_work)
+        _threads.emplace_back([this, worker = uint32_t(i)] {
+            auto seen_generation = uint64_t(0);
+            while (true)
             {
                 {
                     std::unique_lock lock(_work_lock);
-                    _work_conditional.wait(lock);
+                    _work_conditional.wait(
+                      lock,
+                      [this, &seen_generation] {
+                          return !_should_work || _generation != seen_generation;
+                      });
+                    if (!_should_work) return;
+                    seen_generation = _generation;
                 }
-                auto task = _next_task();
-                while (task.has_value())
+
+                // Keep looking until everything is done, a busy worker may still requeue an index
+                auto index = uint32_t(0);
+                while (_remaining > 0)
                 {
-                    task.value()();
-                    task = _next_task();
+                    // Read before looking, so a requeue after the queues came up empty still
+                    // wakes this worker
+                    auto seen_requeues = uint64_t(0);
+                    {
+                        std::lock_guard lock(_idle_lock);
+                        seen_requeues = _requeues;
+                    }
+
+                    if (!_next_index(worker, index))
+                    {
+                        // Fewer indices than workers leaves most of them here, parked not spinning
+                        std::unique_lock lock(_idle_lock);
+                        _idle_conditional.wait(
+                          lock,
+                          [this, seen_requeues]
+                          { return _requeues != seen_requeues || _remaining == 0; });
+                        continue;
+                    }
+
+                    if ((*_task)(index))
+                    {
+                        {
+                            std::lock_guard lock(_queues[worker]->lock);
+                            _queues[worker]->indices.push_back(index);
+                        }
+                        {
+                            std::lock_guard lock(_idle_lock);
+                            _requeues++;
+                        }
+                        _idle_conditional.notify_one();
+                    }
+                    else if (--_remaining == 0)
+                    {
+                        {
+                            std::lock_guard lock(_finished_lock);
+                            _finished_conditional.notify_all();
+                        }
+                        // Taken so a worker between its check and its wait can't miss this
+                        {
+                            std::lock_guard lock(_idle_lock);
+                        }
+                        _idle_conditional.notify_all();
+                    }
                 }
             }
         });
@@ -26,9 +81,10 @@ cr::thread_pool::thread_pool(uint32_t thread_count)
 cr::thread_pool::~thread_pool()
 {
     _should_work = false;
+    for (auto &queue : _queues)
     {
-        std::lock_guard lock(_queue_lock);
-        while (!_tasks.empty()) _tasks.pop();
+        std::lock_guard lock(queue->lock);
+        queue->indices.clear();
     }
     {
         std::lock_guard lock(_work_lock);
@@ -37,38 +93,75 @@ cr::thread_pool::~thread_pool()
     for (auto &thread : _threads) thread.join();
 }
 
-void cr::thread_pool::wait_on_tasks(const std::vector<std::function<void()>> &tasks)
+void cr::thread_pool::parallel_for(uint32_t count, const std::function<void(uint32_t)> &task)
 {
-    _tasks_submitted = tasks.size();
+    parallel_repeat(
+      count,
+      [&task](uint32_t index) {
+          task(index);
+          return false;
+      });
+}
+
+void cr::thread_pool::parallel_repeat(uint32_t count, const std::function<bool(uint32_t)> &task)
+{
+    if (count == 0) return;
+
+    // These have to be visible before any index is, a late worker may pick one up right away
+    _task      = &task;
+    _remaining = count;
+
+    const auto workers = static_cast<uint32_t>(_queues.size());
+    for (auto worker = uint32_t(0); worker < workers; worker++)
     {
-        std::lock_guard lock(_queue_lock);
-        for (const auto &task : tasks)
-            _tasks.push([task, this]() {
-                task();
-                if (_tasks_submitted <= ++_tasks_done)
-                    _finished_conditional.notify_all();
-            });
+        const auto begin = static_cast<uint64_t>(count) * worker / workers;
+        const auto end   = static_cast<uint64_t>(count) * (worker + 1) / workers;
+
+        std::lock_guard lock(_queues[worker]->lock);
+        for (auto index = begin; index < end; index++)
+            _queues[worker]->indices.push_back(static_cast<uint32_t>(index));
     }
-    _work_conditional.notify_all();
 
     {
-        std::unique_lock lock(_finished_lock);
-        _finished_conditional.wait(lock);
-        _tasks_submitted = 0;
-        _tasks_done      = 0;
+        std::lock_guard lock(_work_lock);
+        _generation++;
     }
+    _work_conditional.notify_all();
+
+    std::unique_lock lock(_finished_lock);
+    _finished_conditional.wait(lock, [this] { return _remaining == 0; });
 }
 
-std::optional<std::function<void()>> cr::thread_pool::_next_task()
+uint32_t cr::thread_pool::thread_count() const noexcept
 {
-    std::lock_guard guard(_queue_lock);
+    return static_cast<uint32_t>(_threads.size());
+}
+
+bool cr::thread_pool::_next_index(uint32_t worker, uint32_t &index)
+{
+    {
+        auto &own = *_queues[worker];
+        std::lock_guard lock(own.lock);
+        if (!own.indices.empty())
+        {
+            index = own.indices.front();
+            own.indices.pop_front();
+            return true;
+        }
+    }
 
-    while (!_tasks.empty())
+    // Steal from the back of someone else's block, that's the work they'd get to last
+    for (auto offset = size_t(1); offset < _queues.size(); offset++)
     {
-        auto val = _tasks.front();
-        _tasks.pop();
-        return val;
+        auto &victim = *_queues[(worker + offset) % _queues.size()];
+        std::lock_guard lock(victim.lock);
+        if (!victim.indices.empty())
+        {
+            index = victim.indices.back();
+            victim.indices.pop_back();
+            return true;
+        }
     }
 
-    return {};
+    return false;
 }
@@ -2,12 +2,13 @@
 
 #include <cstdint>
 #include <vector>
+#include <deque>
+#include <algorithm>
+#include <memory>
 #include <thread>
 #include <functional>
-#include <optional>
 #include <atomic>
 #include <mutex>
-#include <queue>
 #include <condition_variable>
 
 #include <fmt/core.h>
@@ -21,23 +22,54 @@ namespace cr
 
         ~thread_pool();
 
-        void wait_on_tasks(const std::vector<std::function<void()>> &tasks);
+        /*
+         * Runs task(index) for every index in [0, count) and blocks until they've all finished.
+         *
+         * Each worker is handed its own contiguous block of indices up front, which it works
+         * through front to back. Once a worker runs dry it steals from the back of the other
+         * workers' blocks, so an expensive block doesn't leave the rest of the pool idle.
+         * The same count always produces the same initial split, so an index tends to stay on
+         * the same worker from one call to the next.
+         */
+        void parallel_for(uint32_t count, const std::function<void(uint32_t)> &task);
+
+        /*
+         * Same scheduling as parallel_for, but when task(index) returns true the index goes to
+         * the back of the worker's own queue and is run again later. Blocks until every index
+         * has returned false. Lets long running work stay on one core without a barrier
+         * between rounds.
+         */
+        void parallel_repeat(uint32_t count, const std::function<bool(uint32_t)> &task);
+
+        [[nodiscard]] uint32_t thread_count() const noexcept;
 
     private:
-        [[nodiscard]] std::optional<std::function<void()>> _next_task();
+        struct worker_queue
+        {
+            std::mutex           lock;
+            std::deque<uint32_t> indices;
+        };
+
+        [[nodiscard]] bool _next_index(uint32_t worker, uint32_t &index);
 
-        std::atomic<bool> _should_work { true };
-        std::atomic<uint32_t> _tasks_submitted = 0;
-        std::atomic<uint32_t> _tasks_done = 0;
+        std::atomic<bool>     _should_work { true };
+        std::atomic<uint32_t> _remaining = 0;
+
+        uint64_t                               _generation = 0;
+        const std::function<bool(uint32_t)> *_task       = nullptr;
 
         std::mutex _work_lock;
-        std::mutex _queue_lock;
         std::mutex _finished_lock;
+        std::mutex _idle_lock;
+
+        // Bumped under _idle_lock whenever an index goes back into a queue
+        uint64_t _requeues = 0;
 
         std::condition_variable _work_conditional;
         std::condition_variable _finished_conditional;
+        std::condition_variable _idle_conditional;
 
-        std::queue<std::function<void()>> _tasks;
-        std::vector<std::thread>          _threads;
+        std::vector<std::unique_ptr<worker_queue>> _queues;
+        std::vector<std::thread>                   _threads;
     };
 }    // namespace cr
@@ -0,0 +1,123 @@
+#include "aov.h"
+
+#include <cstring>
+
+#include <glm/gtc/packing.hpp>
+
+namespace
+{
+    [[nodiscard]] glm::vec2 sign_not_zero(const glm::vec2 &value) noexcept
+    {
+        return glm::vec2(value.x >= 0.0f ? 1.0f : -1.0f, value.y >= 0.0f ? 1.0f : -1.0f);
+    }
+
+    // "A Survey of Efficient Representations for Independent Unit Vectors" (Cigolle 2014)
+    [[nodiscard]] glm::vec2 octahedral_encode(const glm::vec3 &direction) noexcept
+    {
+        const auto length = glm::abs(direction.x) + glm::abs(direction.y) + glm::abs(direction.z);
+        if (length == 0.0f) return glm::vec2(0.0f);
+
+        const auto folded = glm::vec2(direction.x, direction.y) / length;
+        if (direction.z >= 0.0f) return folded;
+
+        return (1.0f - glm::abs(glm::vec2(folded.y, folded.x))) * ::sign_not_zero(folded);
+    }
+
+    [[nodiscard]] glm::vec3 octahedral_decode(const glm::vec2 &encoded) noexcept
+    {
+        auto direction =
+          glm::vec3(encoded.x, encoded.y, 1.0f - glm::abs(encoded.x) - glm::abs(encoded.y));
+        if (direction.z < 0.0f)
+        {
+            const auto unfolded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) *
+              ::sign_not_zero(encoded);
+            direction.x = unfolded.x;
+            direction.y = unfolded.y;
+        }
+
+        return glm::normalize(direction);
+    }
+}    // namespace
+
+cr::aov_buffer::aov_buffer(storage type, uint32_t channels, uint64_t width, uint64_t height)
+    : _storage(type), _channels(channels), _width(width)
+{
+    switch (_storage)
+    {
+    case storage::half: _pixel_size = sizeof(uint16_t) * _channels; break;
+    case storage::octahedral: _pixel_size = sizeof(uint32_t); break;
+    case storage::float32: _pixel_size = sizeof(float) * _channels; break;
+    }
+
+    _data = std::vector<uint8_t>(_pixel_size * width * height);
+}
+
+cr::aov_buffer cr::aov_buffer::create(cr::aov output, uint64_t width, uint64_t height)
+{
+    switch (output)
+    {
+    case cr::aov::albedo: return aov_buffer(storage::half, 3, width, height);
+    case cr::aov::normals: return aov_buffer(storage::octahedral, 3, width, height);
+    case cr::aov::depth: return aov_buffer(storage::float32, 1, width, height);
+    case cr::aov::error: return aov_buffer(storage::float32, 1, width, height);
+    }
+
+    return aov_buffer(storage::float32, 3, width, height);
+}
+
+void cr::aov_buffer::set(uint64_t x, uint64_t y, const glm::vec3 &value) noexcept
+{
+    auto *out = pixel(x, y);
+
+    switch (_storage)
+    {
+    case storage::half:
+    {
+        auto packed = std::array<uint16_t, 3>();
+        for (auto i = 0; i < _channels; i++) packed[i] = glm::packHalf1x16(value[i]);
+        std::memcpy(out, packed.data(), _pixel_size);
+        break;
+    }
+    case storage::octahedral:
+    {
+        const auto packed = glm::packSnorm2x16(::octahedral_encode(value));
+        std::memcpy(out, &packed, _pixel_size);
+        break;
+    }
+    case storage::float32: std::memcpy(out, &value.x, _pixel_size); break;
+    }
+}
+
+void cr::aov_buffer::decode(const uint8_t *packed, size_t count, float *rgba) const noexcept
+{
+    for (auto i = size_t(0); i < count; i++, packed += _pixel_size, rgba += 4)
+    {
+        auto value = glm::vec3(0.0f);
+
+        switch (_storage)
+        {
+        case storage::half:
+        {
+            auto half = std::array<uint16_t, 3>();
+            std::memcpy(half.data(), packed, _pixel_size);
+            for (auto c = 0; c < _channels; c++) value[c] = glm::unpackHalf1x16(half[c]);
+            break;
+        }
+        case storage::octahedral:
+        {
+            auto bits = uint32_t(0);
+            std::memcpy(&bits, packed, _pixel_size);
+            value = ::octahedral_decode(glm::unpackSnorm2x16(bits));
+            break;
+        }
+        case storage::float32: std::memcpy(&value.x, packed, _pixel_size); break;
+        }
+
+        if (_channels == 1) value = glm::vec3(value.x);
+
+        rgba[0] = value.x;
+        rgba[1] = value.y;
+        rgba[2] = value.z;
+        rgba[3] = 1.0f;
+    }
+}
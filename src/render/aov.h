@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+namespace cr
+{
+    // Outputs rendered alongside the colour, each is only allocated and written while requested
+    enum class aov
+    {
+        albedo,
+        normals,
+        depth,
+        error,
+    };
+    constexpr auto aov_count = size_t(4);
+
+    // One AOV packed into the smallest storage that still does its job
+    class aov_buffer
+    {
+    public:
+        enum class storage
+        {
+            half,          // 16 bit float per channel
+            octahedral,    // Unit vector folded onto an octahedron, two 16 bit snorms
+            float32,
+        };
+
+        aov_buffer() = default;
+
+        aov_buffer(storage type, uint32_t channels, uint64_t width, uint64_t height);
+
+        // The storage and channel count the renderer uses for each output
+        [[nodiscard]] static aov_buffer create(cr::aov output, uint64_t width, uint64_t height);
+
+        [[nodiscard]] bool allocated() const noexcept
+        {
+            return !_data.empty();
+        }
+
+        [[nodiscard]] size_t pixel_size() const noexcept
+        {
+            return _pixel_size;
+        }
+
+        [[nodiscard]] uint8_t *pixel(uint64_t x, uint64_t y) noexcept
+        {
+            return _data.data() + (x + y * _width) * _pixel_size;
+        }
+
+        [[nodiscard]] const uint8_t *pixel(uint64_t x, uint64_t y) const noexcept
+        {
+            return _data.data() + (x + y * _width) * _pixel_size;
+        }
+
+        void set(uint64_t x, uint64_t y, const glm::vec3 &value) noexcept;
+
+        // Unpacks count pixels in this buffer's storage to RGBA floats, one channel AOVs are
+        // repeated across RGB
+        void decode(const uint8_t *packed, size_t count, float *rgba) const noexcept;
+
+    private:
+        storage              _storage    = storage::float32;
+        uint32_t             _channels   = 0;
+        size_t               _pixel_size = 0;
+        uint64_t             _width      = 0;
+        std::vector<uint8_t> _data;
+    };
+}    // namespace cr
@@ -7,24 +7,115 @@
 
 namespace cr::brdf
 {
+    // Below this the lobe is narrower than float precision handles well, it's treated as a mirror
+    constexpr auto min_ggx_alpha = 0.001f;
+
+    // Perceptual roughness, squared so the slider is close to linear in how blurry it looks
+    [[nodiscard]] inline float ggx_alpha(float roughness) noexcept
+    {
+        return roughness * roughness;
+    }
+
+    [[nodiscard]] inline bool ggx_is_mirror(float roughness) noexcept
+    {
+        return ggx_alpha(roughness) < min_ggx_alpha;
+    }
+
+    /*
+     * Chance of sampling a cosine weighted direction instead of a visible normal. Very rough
+     * lobes seen head on are close to diffuse, and visible normals send up to a fifth of their
+     * samples under the surface there. Fitted to crender-bench --sampling, where it's never
+     * worse than visible normals alone.
+     */
+    [[nodiscard]] inline float ggx_cosine_share(float roughness, float n_v) noexcept
+    {
+        return glm::clamp((roughness - 0.55f) * (1.0f + 3.0f * n_v), 0.0f, 1.0f);
+    }
+
+    /*
+     * GGX microfacet reflection with the height correlated Smith term, times the cosine towards
+     * the light. view and light both point away from the surface, f0 is the colour head on.
+     */
     [[nodiscard]] inline glm::vec3 ggx(
-      const cr::ray &  incoming,
-      const cr::ray &  outgoing,
+      const glm::vec3 &view,
+      const glm::vec3 &light,
+      const glm::vec3 &normal,
+      const float      roughness,
+      const glm::vec3 &f0)
+    {
+        const auto n_l = glm::dot(normal, light);
+        const auto n_v = glm::dot(normal, view);
+        if (n_l <= 0.0f || n_v <= 0.0f) return glm::vec3(0.0f);
+
+        const auto alpha = ggx_alpha(roughness);
+        const auto h     = glm::normalize(view + light);
+        const auto n_h   = glm::max(0.0f, glm::dot(normal, h));
+        const auto l_h   = glm::max(0.0f, glm::dot(light, h));
+
+        const auto ggx_d = cr::sampling::cook_torrence::specular_d(n_h, alpha);
+        const auto ggx_v = cr::sampling::cook_torrence::specular_g(n_v, n_l, alpha);
+        const auto ggx_f = cr::sampling::cook_torrence::specular_f(l_h, f0);
+
+        return ggx_d * ggx_v * ggx_f * n_l;
+    }
+
+    // Solid angle pdf of sample_ggx picking light
+    [[nodiscard]] inline float ggx_pdf(
+      const glm::vec3 &view,
+      const glm::vec3 &light,
+      const glm::vec3 &normal,
+      const float      roughness)
+    {
+        const auto n_l = glm::dot(normal, light);
+        const auto n_v = glm::dot(normal, view);
+        if (n_l <= 0.0f || n_v <= 0.0f) return 0.0f;
+
+        const auto share = ggx_cosine_share(roughness, n_v);
+        const auto n_h   = glm::dot(normal, glm::normalize(view + light));
+
+        return (1.0f - share) *
+          cr::sampling::ggx::visible_normal_pdf(n_v, n_h, ggx_alpha(roughness)) +
+          share * cr::sampling::hemp_cos_pdf(n_l);
+    }
+
+    struct ggx_sample
+    {
+        glm::vec3 direction;
+        glm::vec3 weight;    // BSDF times the cosine over the pdf, zero under the surface
+        float     pdf;
+    };
+
+    // Reflects the view about a visible normal, or off a rough lobe picks a cosine weighted
+    // direction now and then, see ggx_cosine_share
+    [[nodiscard]] inline ggx_sample sample_ggx(
+      const glm::vec3 &view,
       const glm::vec3 &normal,
       const float      roughness,
-      const float ior)
+      const glm::vec3 &f0,
+      const glm::vec2 &uv)
     {
-        const auto h = glm::normalize(outgoing.direction + -incoming.direction);
-        const auto n_h = glm::dot(normal, h);
+        const auto local = cr::sampling::build_local(normal);
+        const auto frame = glm::mat3(local.tangent, local.bi_tangent, local.normal);
+        const auto share = ggx_cosine_share(roughness, glm::dot(normal, view));
 
-        const auto n_l     = glm::max(0.0f, glm::dot(normal, outgoing.direction));
-        const auto l_h     = glm::dot(outgoing.direction, h);
-        const auto n_dot_v = glm::dot(normal, -incoming.direction);
+        auto out = ggx_sample();
+        if (uv.x < share)
+            out.direction = frame * cr::sampling::cos_hemp(uv.x / share, uv.y);
+        else
+        {
+            const auto u    = glm::min((uv.x - share) / (1.0f - share), 0.99999f);
+            const auto half = frame *
+              cr::sampling::ggx::visible_normal(
+                glm::transpose(frame) * view,
+                ggx_alpha(roughness),
+                glm::vec2(u, uv.y));
 
-        const auto ggx_d = cr::sampling::cook_torrence::specular_d(n_h, roughness);
-        const auto ggx_g = cr::sampling::cook_torrence::specular_g(n_l, n_dot_v, roughness);
-        const auto ggx_f = cr::sampling::cook_torrence::specular_f(ior, l_h);
+            out.direction = glm::reflect(-view, half);
+        }
 
-        return (ggx_d * ggx_g * ggx_f / glm::max(0.000001f, (4 * n_dot_v)));
+        out.pdf    = ggx_pdf(view, out.direction, normal, roughness);
+        out.weight = out.pdf > 0.0f ? ggx(view, out.direction, normal, roughness, f0) / out.pdf
+                                    : glm::vec3(0.0f);
+        return out;
     }
 }    // namespace cr::brdf
@@ -38,6 +38,94 @@ cr::ray cr::camera::get_ray(float x, float y, float aspect)
     }
 }
 
+std::optional<glm::vec3> cr::camera::project(const glm::vec3 &point, float aspect) const
+{
+    // The camera matrix is only a rotation and translation, local is relative to the camera
+    const auto local = glm::vec3(glm::inverse(_cached_matrix) * glm::vec4(point, 1.0f));
+    if (local.z <= 0.0f) return std::nullopt;
+
+    switch (current_mode)
+    {
+    case mode::perspective:
+    {
+        const auto w = 1.0f / glm::tan(0.5f * glm::radians(fov));
+        const auto u = local.x * w / local.z;
+        const auto v = local.y * w / local.z;
+
+        return glm::vec3((u / aspect + 1.0f) * 0.5f, (v + 1.0f) * 0.5f, glm::length(local));
+    }
+    case mode::orthographic:
+    {
+        const auto screen = (glm::vec2(local) / scale + 1.0f) * 0.5f;
+        return glm::vec3(screen, local.z);
+    }
+    }
+
+    return std::nullopt;
+}
+
+cr::ray_packet cr::camera::get_ray_packet(
+  const std::array<float, cr::ray_packet::size> &x,
+  const std::array<float, cr::ray_packet::size> &y,
+  uint32_t                                       count,
+  float                                          aspect)
+{
+    auto packet  = cr::ray_packet();
+    packet.count = count;
+
+    const auto &m = _cached_matrix;
+
+    switch (current_mode)
+    {
+    case mode::perspective:
+    {
+        const auto w = 1.0f / glm::tan(0.5f * glm::radians(fov));
+
+        for (auto i = 0; i < cr::ray_packet::size; i++)
+        {
+            const auto u = (2.0f * x[i] - 1.0f) * aspect;
+            const auto v = 2.0f * y[i] - 1.0f;
+
+            const auto dx = m[0][0] * u + m[1][0] * v + m[2][0] * w;
+            const auto dy = m[0][1] * u + m[1][1] * v + m[2][1] * w;
+            const auto dz = m[0][2] * u + m[1][2] * v + m[2][2] * w;
+
+            const auto inv_length = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz);
+
+            packet.origin_x[i] = position.x;
+            packet.origin_y[i] = position.y;
+            packet.origin_z[i] = position.z;
+
+            packet.direction_x[i] = dx * inv_length;
+            packet.direction_y[i] = dy * inv_length;
+            packet.direction_z[i] = dz * inv_length;
+        }
+        break;
+    }
+    case mode::orthographic:
+    {
+        const auto direction = glm::normalize(glm::vec3(m[2]));
+
+        for (auto i = 0; i < cr::ray_packet::size; i++)
+        {
+            const auto u = scale * (2.0f * x[i] - 1.0f);
+            const auto v = scale * (2.0f * y[i] - 1.0f);
+
+            packet.origin_x[i] = m[0][0] * u + m[1][0] * v + m[3][0];
+            packet.origin_y[i] = m[0][1] * u + m[1][1] * v + m[3][1];
+            packet.origin_z[i] = m[0][2] * u + m[1][2] * v + m[3][2];
+
+            packet.direction_x[i] = direction.x;
+            packet.direction_y[i] = direction.y;
+            packet.direction_z[i] = direction.z;
+        }
+        break;
+    }
+    }
+
+    return packet;
+}
+
 void cr::camera::translate(const glm::vec3 &translation)
 {
     position = glm::vec3(_cached_matrix * glm::vec4(translation, 1.0f));
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <optional>
+
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 #include <glm/gtx/euler_angles.hpp>
@@ -28,6 +30,17 @@ namespace cr
 
         [[nodiscard]] cr::ray get_ray(float x, float y, float aspect);
 
+        // Inverse of get_ray: the screen position in [0, 1] whose ray passes through the point,
+        // and how far along that ray it is. Empty for points behind the camera
+        [[nodiscard]] std::optional<glm::vec3> project(const glm::vec3 &point, float aspect) const;
+
+        // Same as get_ray for every lane, laid out so the compiler can vectorise it
+        [[nodiscard]] cr::ray_packet get_ray_packet(
+          const std::array<float, cr::ray_packet::size> &x,
+          const std::array<float, cr::ray_packet::size> &y,
+          uint32_t                                       count,
+          float                                          aspect);
+
         float fov;
         float scale;
 
@@ -0,0 +1,402 @@
+#include "checkpoint.h"
+
+#include <array>
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <filesystem>
+
+#include <stb/stb_image.h>
+
+#include <render/metrics.h>
+#include <util/logger.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Defined by stb_image_write's implementation in asset_loader.cpp, which only declares it there
+extern "C" unsigned char *
+  stbi_zlib_compress(unsigned char *data, int data_len, int *out_len, int quality);
+
+namespace
+{
+    constexpr auto magic   = std::array<char, 4>({ 'C', 'R', 'C', 'P' });
+    constexpr auto version = uint32_t(1);
+
+    constexpr auto compressed_flag = uint32_t(1);
+
+    // Deflate works on int sizes, large renders are compressed in pieces
+    constexpr auto chunk_size = size_t(64) << 20u;
+
+    class writer
+    {
+    public:
+        template<typename T>
+        void put(const T &value)
+        {
+            const auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+            _bytes.insert(_bytes.end(), bytes, bytes + sizeof(T));
+        }
+
+        template<typename T>
+        void put(const std::vector<T> &values)
+        {
+            put(static_cast<uint64_t>(values.size()));
+
+            const auto *bytes = reinterpret_cast<const uint8_t *>(values.data());
+            _bytes.insert(_bytes.end(), bytes, bytes + values.size() * sizeof(T));
+        }
+
+        void put_bytes(const uint8_t *data, size_t size)
+        {
+            _bytes.insert(_bytes.end(), data, data + size);
+        }
+
+        [[nodiscard]] std::vector<uint8_t> &bytes() noexcept
+        {
+            return _bytes;
+        }
+
+    private:
+        std::vector<uint8_t> _bytes;
+    };
+
+    // Every read is bounds checked, once one fails the rest do too
+    class reader
+    {
+    public:
+        reader(const uint8_t *data, size_t size) : _data(data), _size(size) { }
+
+        template<typename T>
+        bool get(T &value)
+        {
+            if (!_take(sizeof(T))) return false;
+
+            std::memcpy(&value, _data + _offset - sizeof(T), sizeof(T));
+            return true;
+        }
+
+        template<typename T>
+        bool get(std::vector<T> &values)
+        {
+            auto count = uint64_t(0);
+            if (!get(count) || count > (_size - _offset) / sizeof(T)) return _good = false;
+
+            values.resize(count);
+            _take(count * sizeof(T));
+            std::memcpy(values.data(), _data + _offset - count * sizeof(T), count * sizeof(T));
+            return true;
+        }
+
+        [[nodiscard]] const uint8_t *get_bytes(size_t size)
+        {
+            return _take(size) ? _data + _offset - size : nullptr;
+        }
+
+        [[nodiscard]] bool good() const noexcept
+        {
+            return _good;
+        }
+
+    private:
+        bool _take(size_t size)
+        {
+            if (!_good || size > _size - _offset) return _good = false;
+
+            _offset += size;
+            return true;
+        }
+
+        const uint8_t *_data;
+        size_t         _size;
+        size_t         _offset = 0;
+        bool           _good   = true;
+    };
+
+    // Pushes what was written to the file out to the disk, not just the OS cache
+    [[nodiscard]] bool sync_file(std::FILE *file) noexcept
+    {
+        if (std::fflush(file) != 0) return false;
+#ifdef _WIN32
+        return _commit(_fileno(file)) == 0;
+#else
+        return fsync(fileno(file)) == 0;
+#endif
+    }
+
+    // The rename itself only survives a crash once its directory is synced, Windows has no
+    // equivalent for directories
+    void sync_directory(const std::filesystem::path &directory) noexcept
+    {
+#ifndef _WIN32
+        const auto file = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+        if (file < 0) return;
+
+        static_cast<void>(fsync(file));
+        close(file);
+#endif
+    }
+
+    // Byte i of every 4 byte value goes into plane i, the leftover tail is kept as is
+    [[nodiscard]] std::vector<uint8_t> shuffle(const std::vector<uint8_t> &bytes)
+    {
+        const auto values = bytes.size() / 4;
+
+        auto out = std::vector<uint8_t>(bytes.size());
+        for (auto i = size_t(0); i < values; i++)
+            for (auto b = 0; b < 4; b++) out[b * values + i] = bytes[i * 4 + b];
+
+        std::copy(bytes.begin() + values * 4, bytes.end(), out.begin() + values * 4);
+        return out;
+    }
+
+    [[nodiscard]] std::vector<uint8_t> unshuffle(const std::vector<uint8_t> &planes)
+    {
+        const auto values = planes.size() / 4;
+
+        auto out = std::vector<uint8_t>(planes.size());
+        for (auto i = size_t(0); i < values; i++)
+            for (auto b = 0; b < 4; b++) out[i * 4 + b] = planes[b * values + i];
+
+        std::copy(planes.begin() + values * 4, planes.end(), out.begin() + values * 4);
+        return out;
+    }
+
+    [[nodiscard]] std::vector<uint8_t> serialise(const cr::checkpoint::state &checkpoint)
+    {
+        auto out = ::writer();
+        out.put(checkpoint.fingerprint);
+        out.put(checkpoint.width);
+        out.put(checkpoint.height);
+        out.put(checkpoint.tile_width);
+        out.put(checkpoint.tile_height);
+        out.put(checkpoint.tile_samples);
+        out.put(checkpoint.sampler);
+        out.put(checkpoint.elapsed);
+        out.put(checkpoint.first_sample);
+        out.put(checkpoint.region_min);
+        out.put(checkpoint.region_max);
+        out.put(checkpoint.raw);
+        out.put(checkpoint.moments);
+        out.put(checkpoint.progress);
+        out.put(checkpoint.retired);
+        out.put(checkpoint.counters);
+        return std::move(out.bytes());
+    }
+
+    [[nodiscard]] std::optional<cr::checkpoint::state>
+      deserialise(const std::vector<uint8_t> &bytes)
+    {
+        auto in         = ::reader(bytes.data(), bytes.size());
+        auto checkpoint = cr::checkpoint::state();
+        in.get(checkpoint.fingerprint);
+        in.get(checkpoint.width);
+        in.get(checkpoint.height);
+        in.get(checkpoint.tile_width);
+        in.get(checkpoint.tile_height);
+        in.get(checkpoint.tile_samples);
+        in.get(checkpoint.sampler);
+        in.get(checkpoint.elapsed);
+        in.get(checkpoint.first_sample);
+        in.get(checkpoint.region_min);
+        in.get(checkpoint.region_max);
+        in.get(checkpoint.raw);
+        in.get(checkpoint.moments);
+        in.get(checkpoint.progress);
+        in.get(checkpoint.retired);
+        in.get(checkpoint.counters);
+        const auto resolution = glm::ivec2(checkpoint.width, checkpoint.height);
+        const auto tile_size  = glm::ivec2(checkpoint.tile_width, checkpoint.tile_height);
+        if (!in.good() || glm::any(glm::lessThan(tile_size, glm::ivec2(1))) ||
+            glm::any(glm::lessThan(checkpoint.region_min, glm::ivec2(0))) ||
+            glm::any(glm::lessThanEqual(checkpoint.region_max, checkpoint.region_min)) ||
+            glm::any(glm::greaterThan(checkpoint.region_max, resolution)))
+            return std::nullopt;
+
+        // Same grid as the renderer builds over the region
+        const auto first_tile = checkpoint.region_min / tile_size;
+        const auto last_tile  = (checkpoint.region_max + tile_size - 1) / tile_size;
+        const auto tiles      = static_cast<size_t>(last_tile.x - first_tile.x) *
+          static_cast<size_t>(last_tile.y - first_tile.y);
+        const auto pixels = checkpoint.width * checkpoint.height;
+
+        const auto consistent = checkpoint.raw.size() == pixels * 4 &&
+          checkpoint.moments.size() == pixels && checkpoint.progress.size() == tiles &&
+          checkpoint.retired.size() == tiles &&
+          checkpoint.counters.size() == tiles * cr::metrics::counter_count;
+        if (!consistent) return std::nullopt;
+
+        return checkpoint;
+    }
+}    // namespace
+
+void cr::checkpoint::fingerprint::add(const void *data, size_t size) noexcept
+{
+    constexpr auto prime = 1099511628211ull;
+
+    // A word at a time rather than a byte, scenes and skyboxes run to hundreds of megabytes
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    const auto  words = size / sizeof(uint64_t);
+    for (auto i = size_t(0); i < words; i++, bytes += sizeof(uint64_t))
+    {
+        auto word = uint64_t(0);
+        std::memcpy(&word, bytes, sizeof(uint64_t));
+        _hash = (_hash ^ word) * prime;
+    }
+
+    for (auto i = words * sizeof(uint64_t); i < size; i++, bytes++)
+        _hash = (_hash ^ *bytes) * prime;
+}
+
+bool cr::checkpoint::write(const std::string &path, const state &checkpoint, bool compress)
+{
+    auto payload = ::serialise(checkpoint);
+
+    auto file = ::writer();
+    file.put(::magic);
+    file.put(::version);
+    file.put(compress ? ::compressed_flag : uint32_t(0));
+    file.put(static_cast<uint64_t>(payload.size()));
+
+    if (compress)
+    {
+        payload = ::shuffle(payload);
+
+        const auto chunks = (payload.size() + ::chunk_size - 1) / ::chunk_size;
+        file.put(static_cast<uint64_t>(chunks));
+        for (auto i = size_t(0); i < chunks; i++)
+        {
+            const auto offset = i * ::chunk_size;
+            const auto size   = std::min(::chunk_size, payload.size() - offset);
+
+            auto  compressed_size = 0;
+            auto *compressed      = stbi_zlib_compress(
+              payload.data() + offset,
+              static_cast<int>(size),
+              &compressed_size,
+              5);
+            if (!compressed)
+            {
+                cr::logger::error("Failed to compress checkpoint [{}]", path);
+                return false;
+            }
+
+            file.put(static_cast<uint64_t>(compressed_size));
+            file.put_bytes(compressed, compressed_size);
+            std::free(compressed);
+        }
+    }
+    else
+        file.put_bytes(payload.data(), payload.size());
+
+    // Synced before the rename, otherwise a crash can leave the new name on a truncated file
+    const auto temporary = path + ".tmp";
+    {
+        auto *out     = std::fopen(temporary.c_str(), "wb");
+        auto  written = out &&
+          std::fwrite(file.bytes().data(), 1, file.bytes().size(), out) == file.bytes().size() &&
+          ::sync_file(out);
+        if (out) written = std::fclose(out) == 0 && written;
+        if (!written)
+        {
+            cr::logger::error("Failed to write checkpoint [{}]", temporary);
+            return false;
+        }
+    }
+
+    auto error = std::error_code();
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        cr::logger::error("Failed to move checkpoint into [{}]: {}", path, error.message());
+        return false;
+    }
+    ::sync_directory(std::filesystem::path(path).parent_path());
+
+    return true;
+}
+
+std::optional<cr::checkpoint::state> cr::checkpoint::read(const std::string &path)
+{
+    auto file = std::ifstream(path, std::ios::binary);
+    if (!file)
+    {
+        cr::logger::error("Failed to open checkpoint [{}]", path);
+        return std::nullopt;
+    }
+
+    const auto bytes =
+      std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    auto in           = ::reader(bytes.data(), bytes.size());
+    auto file_magic   = std::array<char, 4>();
+    auto file_version = uint32_t(0);
+    auto flags        = uint32_t(0);
+    auto payload_size = uint64_t(0);
+    in.get(file_magic);
+    in.get(file_version);
+    in.get(flags);
+    in.get(payload_size);
+    if (!in.good() || file_magic != ::magic || file_version != ::version)
+    {
+        cr::logger::error("[{}] isn't a checkpoint of this version", path);
+        return std::nullopt;
+    }
+
+    auto payload = std::vector<uint8_t>();
+    if (flags & ::compressed_flag)
+    {
+        auto chunks = uint64_t(0);
+        in.get(chunks);
+
+        for (auto i = uint64_t(0); i < chunks && in.good(); i++)
+        {
+            auto compressed_size = uint64_t(0);
+            in.get(compressed_size);
+
+            const auto *compressed = in.get_bytes(compressed_size);
+            if (!compressed || compressed_size > std::numeric_limits<int>::max()) break;
+
+            auto  size         = 0;
+            auto *decompressed = stbi_zlib_decode_malloc(
+              reinterpret_cast<const char *>(compressed),
+              static_cast<int>(compressed_size),
+              &size);
+            if (!decompressed) break;
+
+            payload.insert(payload.end(), decompressed, decompressed + size);
+            std::free(decompressed);
+        }
+
+        payload = ::unshuffle(payload);
+    }
+    else if (const auto *data = in.get_bytes(payload_size))
+        payload.assign(data, data + payload_size);
+
+    auto checkpoint = std::optional<state>();
+    if (payload.size() == payload_size) checkpoint = ::deserialise(payload);
+    if (!checkpoint) cr::logger::error("Checkpoint [{}] is damaged", path);
+
+    return checkpoint;
+}
+
+bool cr::checkpoint::merge(state &into, const state &partial)
+{
+    if (partial.fingerprint != into.fingerprint || partial.width != into.width ||
+        partial.height != into.height || partial.raw.size() != into.raw.size() ||
+        partial.moments.size() != into.moments.size())
+        return false;
+
+    for (auto p = size_t(0); p < into.raw.size(); p++) into.raw[p] += partial.raw[p];
+    for (auto p = size_t(0); p < into.moments.size(); p++) into.moments[p] += partial.moments[p];
+    into.elapsed += partial.elapsed;
+    return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+#include <glm/glm.hpp>
+
+namespace cr::checkpoint
+{
+    // FNV-1a over everything added, in the order it was added, fed 64 bits at a time
+    class fingerprint
+    {
+    public:
+        void add(const void *data, size_t size) noexcept;
+
+        template<typename T>
+        void add(const T &value) noexcept
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "Add the members one by one instead");
+            add(&value, sizeof(T));
+        }
+
+        template<typename T>
+        void add(const std::vector<T> &values) noexcept
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "Add the members one by one instead");
+            add(values.size());
+            add(values.data(), values.size() * sizeof(T));
+        }
+
+        [[nodiscard]] uint64_t value() const noexcept
+        {
+            return _hash;
+        }
+
+    private:
+        uint64_t _hash = 14695981039346656037ull;
+    };
+
+    /*
+     * Everything needed to carry on accumulating where a render left off. Samplers are pure
+     * functions of pixel, sample index and dimension, so each tile's progress is all the random
+     * state there is. Also the raw output of a partial render, the sums of partials of one frame
+     * add up to the whole.
+     */
+    struct state
+    {
+        uint64_t fingerprint  = 0;    // Scene, camera and the settings the image depends on
+        uint64_t width        = 0;
+        uint64_t height       = 0;
+        int32_t  tile_width   = 0;
+        int32_t  tile_height  = 0;
+        uint64_t tile_samples = 0;
+        uint32_t sampler      = 0;      // cr::sampler::type
+        double   elapsed      = 0.0;    // Seconds rendered so far
+        uint64_t first_sample = 0;      // Sample index the render's own samples start at
+
+        // Pixels the tiles cover, the whole image unless it's a partial render
+        glm::ivec2 region_min = glm::ivec2(0, 0);
+        glm::ivec2 region_max = glm::ivec2(0, 0);
+
+        std::vector<float>    raw;         // Radiance sum and sample count per pixel
+        std::vector<float>    moments;     // Sum of squared luminance per pixel
+        std::vector<uint64_t> progress;    // Per tile
+        std::vector<uint8_t>  retired;     // Per tile
+        std::vector<uint64_t> counters;    // cr::metrics::counter_count per tile
+    };
+
+    /*
+     * Writes next to the target, syncs it to the disk and renames over it, so a node going down
+     * mid write or right after leaves either the previous checkpoint or the new one intact.
+     * Compression splits every 4 byte value into byte planes first, the sums' exponents and
+     * high bytes then deflate well.
+     */
+    bool write(const std::string &path, const state &checkpoint, bool compress);
+
+    // Empty if the file is missing, truncated or its sizes don't add up
+    [[nodiscard]] std::optional<state> read(const std::string &path);
+
+    // Adds the sums of a partial render into those of another, false if it's of another frame
+    [[nodiscard]] bool merge(state &into, const state &partial);
+}    // namespace cr::checkpoint
@@ -62,9 +62,9 @@ namespace cr::entity
 
     struct embree_ctx
     {
-        embree_ctx()
+        embree_ctx() = default;
+        explicit embree_ctx(RTCDevice device) : device(device)
         {
-            device   = rtcNewDevice(nullptr);
             scene    = rtcNewScene(device);
             geometry = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE);
         }
@@ -48,7 +48,7 @@ cr::registry::registry()
       sun_dir_local_coords.bi_tangent);
 }
 
-void cr::registry::register_model(const cr::asset_loader::model_data &data)
+uint32_t cr::registry::register_model(const cr::asset_loader::model_data &data, RTCDevice device)
 {
     // Expand the data we have have from the indices. Why?
     // Good question - I'm waiting on Intels Embree team to reply to my github issue - And give a
@@ -57,7 +57,9 @@ void cr::registry::register_model(const cr::asset_loader::model_data &data)
 
     auto entity = entities.create();
 
+#ifndef CRENDER_HEADLESS
     _upload_gpu_meshes(data, entity);
+#endif
 
     auto indices = std::make_unique<std::vector<uint32_t>>(data.vertex_indices.size());
     std::generate(indices->begin(), indices->end(), [n = 0]() mutable { return n++; });
@@ -68,7 +70,7 @@ void cr::registry::register_model(const cr::asset_loader::model_data &data)
     static auto current_model_count = uint32_t(0);
 
     // Create the model embree instance
-    auto model_instance = cr::model::instance_geometry(*vertices, *indices, *texture_coords);
+    auto model_instance = cr::model::instance_geometry(device, *vertices, *indices, *texture_coords);
 
     auto instances = std::vector<glm::mat4>(1);
     instances[0]   = glm::mat4(1);
@@ -94,8 +96,11 @@ void cr::registry::register_model(const cr::asset_loader::model_data &data)
     entities.emplace<cr::entity::embree_ctx>(entity, model_instance);
     entities.emplace<cr::entity::instances>(entity, instances);
     entities.emplace<std::string>(entity, data.name);
+
+    return entity;
 }
 
+#ifndef CRENDER_HEADLESS
 void cr::registry::_upload_gpu_meshes(const cr::asset_loader::model_data &data, uint32_t entity)
 {
     struct mesh
@@ -208,6 +213,8 @@ void cr::registry::_upload_gpu_meshes(const cr::asset_loader::model_data &data,
     }
 }
 
+#endif
+
 std::vector<float> cr::registry::_zip_mesh_data(
   const std::vector<glm::vec3> &vertices,
   const std::vector<glm::vec3> &normals,
@@ -27,11 +27,13 @@ namespace cr
 
         entt::basic_registry<uint32_t> entities;
 
-        /* Load a model into the register after loading it in */
-        void register_model(const cr::asset_loader::model_data &data);
+        /* Load a model into the register after loading it in, its BVH is built on the given device */
+        uint32_t register_model(const cr::asset_loader::model_data &data, RTCDevice device);
 
     private:
+#ifndef CRENDER_HEADLESS
         void _upload_gpu_meshes(const cr::asset_loader::model_data &data, uint32_t entity);
+#endif
 
         [[nodiscard]] std::vector<float> _zip_mesh_data(
           const std::vector<glm::vec3> &vertices,
@@ -0,0 +1,151 @@
+#include "environment.h"
+
+#include <thread>
+#include <numeric>
+#include <algorithm>
+
+#include <util/numbers.h>
+
+namespace
+{
+    [[nodiscard]] float luminance(const glm::vec4 &colour) noexcept
+    {
+        return glm::dot(glm::vec3(colour), glm::vec3(0.2126f, 0.7152f, 0.0722f));
+    }
+
+    // Bin of the CDF u falls in and how far into it, empty bins are never picked
+    [[nodiscard]] uint64_t pick(const float *cdf, uint64_t count, float u, float &offset) noexcept
+    {
+        const auto *upper = std::upper_bound(cdf + 1, cdf + count + 1, u);
+        const auto  index = static_cast<uint64_t>(
+          glm::clamp<std::ptrdiff_t>(upper - cdf - 1, 0, static_cast<std::ptrdiff_t>(count) - 1));
+
+        const auto width = cdf[index + 1] - cdf[index];
+        offset = width > 0.0f ? glm::clamp((u - cdf[index]) / width, 0.0f, 0.9999f) : 0.5f;
+        return index;
+    }
+}    // namespace
+
+cr::environment_map::environment_map(const cr::image &skybox, float vertical_rotation)
+    : _width(skybox.width()), _height(skybox.height())
+{
+    if (_width == 0 || _height == 0) return;
+
+    _conditional.resize((_width + 1) * _height);
+    _weights.resize(_width * _height);
+    auto row_sums = std::vector<double>(_height);
+
+    // Every row only writes its own part of the tables
+    const auto build_rows =
+      [this, &skybox, &row_sums, vertical_rotation](uint64_t first, uint64_t last)
+    {
+        for (auto y = first; y < last; y++)
+        {
+            // The lookup adds the rotation, the row shows at the latitude it's taken away from
+            const auto v =
+              glm::fract((static_cast<float>(y) + 0.5f) / _height - vertical_rotation);
+            const auto sin_theta = glm::sin(cr::numbers<float>::pi * v);
+
+            auto *cdf = _conditional.data() + y * (_width + 1);
+            auto  sum = 0.0;
+            cdf[0]    = 0.0f;
+            for (auto x = uint64_t(0); x < _width; x++)
+            {
+                // Also catches NaNs and negative texels
+                auto weight = ::luminance(skybox.get(x, y)) * sin_theta;
+                if (!(weight > 0.0f)) weight = 0.0f;
+
+                _weights[x + y * _width] = weight;
+                sum += weight;
+                cdf[x + 1] = static_cast<float>(sum);
+            }
+
+            // A black row is never picked by the marginal, its CDF only has to be valid
+            for (auto x = uint64_t(1); x <= _width; x++)
+                cdf[x] = sum > 0.0 ? static_cast<float>(cdf[x] / sum)
+                                   : static_cast<float>(x) / static_cast<float>(_width);
+            cdf[_width] = 1.0f;
+
+            row_sums[y] = sum;
+        }
+    };
+
+    const auto threads =
+      glm::clamp<uint64_t>(std::thread::hardware_concurrency(), uint64_t(1), _height);
+    auto workers = std::vector<std::thread>();
+    for (auto i = uint64_t(1); i < threads; i++)
+        workers.emplace_back(build_rows, _height * i / threads, _height * (i + 1) / threads);
+    build_rows(0, _height / threads);
+    for (auto &worker : workers) worker.join();
+
+    const auto total = std::accumulate(row_sums.begin(), row_sums.end(), 0.0);
+    if (total <= 0.0)
+    {
+        // Nothing to sample, every lookup is black anyway
+        _conditional.clear();
+        _weights.clear();
+        return;
+    }
+
+    _marginal.resize(_height + 1);
+    auto running = 0.0;
+    for (auto y = uint64_t(0); y < _height; y++)
+    {
+        running += row_sums[y];
+        _marginal[y + 1] = static_cast<float>(running / total);
+    }
+    _marginal[_height] = 1.0f;
+
+    // A texel's share of the total, spread over its 1 / (width * height) of the uv square
+    _density_scale = static_cast<float>(static_cast<double>(_width * _height) / total);
+}
+
+glm::vec2 cr::environment_map::to_uv(const glm::vec3 &direction) noexcept
+{
+    return glm::vec2(
+      0.5f + atan2f(direction.z, direction.x) * cr::numbers<float>::inv_tau,
+      0.5f - asinf(glm::clamp(direction.y, -1.0f, 1.0f)) * cr::numbers<float>::inv_pi);
+}
+
+glm::vec3 cr::environment_map::to_direction(const glm::vec2 &uv) noexcept
+{
+    const auto theta = cr::numbers<float>::pi * uv.y;
+    const auto phi   = cr::numbers<float>::tau * (uv.x - 0.5f);
+
+    const auto sin_theta = glm::sin(theta);
+    return glm::vec3(sin_theta * glm::cos(phi), glm::cos(theta), sin_theta * glm::sin(phi));
+}
+
+cr::environment_map::direction_sample
+  cr::environment_map::sample(const glm::vec2 &random, const glm::vec2 &rotation) const noexcept
+{
+    if (empty()) return { glm::vec3(0.0f, 1.0f, 0.0f), 0.0f };
+
+    auto       offset = glm::vec2();
+    const auto row    = ::pick(_marginal.data(), _height, random.y, offset.y);
+    const auto column =
+      ::pick(_conditional.data() + row * (_width + 1), _width, random.x, offset.x);
+
+    const auto texel = (glm::vec2(column, row) + offset) / glm::vec2(_width, _height);
+    const auto out   = to_direction(glm::fract(texel - rotation));
+
+    // Looked up the way the radiance is, so the two always agree on the texel
+    return { out, pdf(out, rotation) };
+}
+
+float cr::environment_map::pdf(const glm::vec3 &direction, const glm::vec2 &rotation) const noexcept
+{
+    if (empty()) return 0.0f;
+
+    const auto sin_theta = glm::sqrt(glm::max(0.0f, 1.0f - direction.y * direction.y));
+    if (sin_theta == 0.0f) return 0.0f;
+
+    // Same texel as cr::image::get_uv
+    const auto uv = to_uv(direction) + rotation;
+    const auto x  = static_cast<uint64_t>(uv.x * _width) % _width;
+    const auto y  = static_cast<uint64_t>(uv.y * _height) % _height;
+
+    // The uv square maps onto the sphere with a Jacobian of 2 pi^2 sin(theta)
+    const auto uv_pdf = _weights[x + y * _width] * _density_scale;
+    return uv_pdf / (2.0f * cr::numbers<float>::pi * cr::numbers<float>::pi * sin_theta);
+}
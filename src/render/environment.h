@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include <objects/image.h>
+
+namespace cr
+{
+    /*
+     * Picks directions towards an equirectangular skybox in proportion to the light coming from
+     * them. A marginal CDF picks the row and that row's conditional CDF the texel, both weighted
+     * by luminance times the solid angle the texel covers.
+     */
+    class environment_map
+    {
+    public:
+        struct direction_sample
+        {
+            glm::vec3 direction;
+            float     pdf;    // Solid angle
+        };
+
+        environment_map() = default;
+
+        // Rows are built in parallel. The vertical rotation moves texels to other latitudes, so
+        // changing it means building again, the horizontal one doesn't
+        environment_map(const cr::image &skybox, float vertical_rotation);
+
+        // Where a direction lands on the skybox before its rotation is added
+        [[nodiscard]] static glm::vec2 to_uv(const glm::vec3 &direction) noexcept;
+
+        [[nodiscard]] static glm::vec3 to_direction(const glm::vec2 &uv) noexcept;
+
+        // Empty without a skybox, or with one that's black everywhere
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return _marginal.empty();
+        }
+
+        // rotation is what the skybox lookup adds to the coordinates
+        [[nodiscard]] direction_sample
+          sample(const glm::vec2 &random, const glm::vec2 &rotation) const noexcept;
+
+        // Density of sample picking the direction, zero when empty
+        [[nodiscard]] float
+          pdf(const glm::vec3 &direction, const glm::vec2 &rotation) const noexcept;
+
+    private:
+        uint64_t           _width  = 0;
+        uint64_t           _height = 0;
+        std::vector<float> _marginal;       // Over rows, height + 1 entries
+        std::vector<float> _conditional;    // Over each row's texels, width + 1 entries per row
+        std::vector<float> _weights;        // Per texel, times _density_scale is the pdf over uv
+        float              _density_scale = 0.0f;
+    };
+}    // namespace cr
@@ -32,7 +32,7 @@ namespace cr
         {
             type                    shade_type           = smooth;
             float                   ior            = 1.5;
-            float                   roughness      = 0.5;
+            float                   roughness      = 0;    // Metal only, 0 is a mirror
             float                   reflectiveness = 1;
             float                   emission       = 0;
             glm::vec4               colour         = glm::vec4(1, 1, 1, 1);
@@ -0,0 +1,187 @@
+#include "metrics.h"
+
+#include <fstream>
+#include <filesystem>
+
+#include <fmt/core.h>
+
+#include <util/logger.h>
+
+namespace
+{
+    struct counter_info
+    {
+        const char *name;
+        const char *help;
+    };
+
+    constexpr auto counter_infos = std::array<counter_info, cr::metrics::counter_count>({
+      counter_info { "camera_rays", "Camera rays traced" },
+      counter_info { "bounce_rays", "Rays traced after the first bounce" },
+      counter_info { "shadow_rays", "Occlusion rays traced for light sampling (sun and skybox)" },
+      counter_info { "alpha_skips", "Hits thrown away by an alpha cut out" },
+      counter_info { "misses", "Camera and bounce rays that left the scene" },
+      counter_info { "roulette_kills", "Paths ended by Russian roulette" },
+      counter_info { "passes", "Tile passes rendered" },
+      counter_info { "trace", "Time spent tracing rays, only while profiling" },
+      counter_info { "shade", "Time spent shading hits, only while profiling" },
+      counter_info { "accumulate", "Time spent accumulating samples, only while profiling" },
+      counter_info { "pass", "Time spent in tile passes" },
+      counter_info { "slowest_pass", "Longest single tile pass" },
+    });
+
+    [[nodiscard]] bool is_time(cr::metrics::counter value) noexcept
+    {
+        return value >= cr::metrics::counter::trace_ns;
+    }
+}    // namespace
+
+const char *cr::metrics::name(counter value) noexcept
+{
+    return ::counter_infos[static_cast<size_t>(value)].name;
+}
+
+const char *cr::metrics::help(counter value) noexcept
+{
+    return ::counter_infos[static_cast<size_t>(value)].help;
+}
+
+cr::metrics::counters &cr::metrics::counters::operator+=(const counters &other) noexcept
+{
+    for (auto i = 0; i < counter_count; i++)
+        if (static_cast<counter>(i) == counter::slowest_pass_ns)
+            values[i] = std::max(values[i], other.values[i]);
+        else
+            values[i] += other.values[i];
+
+    return *this;
+}
+
+void cr::metrics::tile_counters::merge(const counters &pass) noexcept
+{
+    // Relaxed is enough, readers only ever want a recent total
+    for (auto i = 0; i < counter_count; i++)
+        if (static_cast<counter>(i) == counter::slowest_pass_ns)
+            values[i].store(
+              std::max(values[i].load(std::memory_order_relaxed), pass.values[i]),
+              std::memory_order_relaxed);
+        else
+            values[i].fetch_add(pass.values[i], std::memory_order_relaxed);
+}
+
+void cr::metrics::tile_counters::reset() noexcept
+{
+    for (auto &value : values) value.store(0, std::memory_order_relaxed);
+}
+
+void cr::metrics::tile_counters::add_to(counters &totals) const noexcept
+{
+    auto tile = counters();
+    for (auto i = 0; i < counter_count; i++)
+        tile.values[i] = values[i].load(std::memory_order_relaxed);
+
+    totals += tile;
+}
+
+std::string cr::metrics::to_openmetrics(const counters &totals, const std::vector<gauge> &gauges)
+{
+    auto out = std::string();
+
+    for (auto i = 0; i < counter_count; i++)
+    {
+        const auto value = static_cast<counter>(i);
+
+        if (value == counter::slowest_pass_ns)
+        {
+            out += fmt::format(
+              "# TYPE crender_{0}_seconds gauge\n"
+              "# UNIT crender_{0}_seconds seconds\n"
+              "# HELP crender_{0}_seconds {1}.\n"
+              "crender_{0}_seconds {2}\n",
+              name(value),
+              help(value),
+              totals.seconds(value));
+        }
+        else if (::is_time(value))
+        {
+            out += fmt::format(
+              "# TYPE crender_{0}_seconds counter\n"
+              "# UNIT crender_{0}_seconds seconds\n"
+              "# HELP crender_{0}_seconds {1}.\n"
+              "crender_{0}_seconds_total {2}\n",
+              name(value),
+              help(value),
+              totals.seconds(value));
+        }
+        else
+        {
+            out += fmt::format(
+              "# TYPE crender_{0} counter\n"
+              "# HELP crender_{0} {1}.\n"
+              "crender_{0}_total {2}\n",
+              name(value),
+              help(value),
+              totals[value]);
+        }
+    }
+
+    for (const auto &current : gauges)
+        out += fmt::format(
+          "# TYPE crender_{0} gauge\n"
+          "# HELP crender_{0} {1}.\n"
+          "crender_{0} {2}\n",
+          current.name,
+          current.help,
+          current.value);
+
+    out += "# EOF\n";
+    return out;
+}
+
+std::string cr::metrics::to_json(const counters &totals, const std::vector<gauge> &gauges)
+{
+    auto out = std::string("{\n");
+
+    for (auto i = 0; i < counter_count; i++)
+    {
+        const auto value = static_cast<counter>(i);
+
+        if (::is_time(value))
+            out += fmt::format("  \"{}_seconds\": {},\n", name(value), totals.seconds(value));
+        else
+            out += fmt::format("  \"{}\": {},\n", name(value), totals[value]);
+    }
+
+    for (const auto &current : gauges)
+        out += fmt::format("  \"{}\": {},\n", current.name, current.value);
+
+    // Drop the trailing comma
+    out.erase(out.size() - 2, 1);
+    out += "}\n";
+    return out;
+}
+
+bool cr::metrics::write_file(const std::string &path, const std::string &contents)
+{
+    const auto temporary = path + ".tmp";
+
+    {
+        auto file = std::ofstream(temporary, std::ios::binary | std::ios::trunc);
+        file << contents;
+        if (!file)
+        {
+            cr::logger::error("Failed to write metrics to [{}]", temporary);
+            return false;
+        }
+    }
+
+    auto error = std::error_code();
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        cr::logger::error("Failed to move metrics into [{}]: {}", path, error.message());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace cr::metrics
+{
+    enum class counter
+    {
+        camera_rays,
+        bounce_rays,
+        shadow_rays,
+        alpha_skips,       // Hits thrown away by an alpha cut out
+        misses,            // Camera and bounce rays that left the scene
+        roulette_kills,    // Paths ended by Russian roulette
+        passes,            // Tile passes, one tile taking its next few samples
+
+        // Nanoseconds. The stage timers are only taken while profiling, the pass time always is
+        trace_ns,
+        shade_ns,
+        accumulate_ns,
+        pass_ns,
+        slowest_pass_ns,    // Longest single pass, kept as a maximum rather than a sum
+    };
+    constexpr auto counter_count = size_t(12);
+
+    [[nodiscard]] const char *name(counter value) noexcept;
+
+    [[nodiscard]] const char *help(counter value) noexcept;
+
+    // Plain counters a worker fills in over one tile pass, also used for the merged totals
+    struct counters
+    {
+        std::array<uint64_t, counter_count> values {};
+
+        [[nodiscard]] uint64_t &operator[](counter value) noexcept
+        {
+            return values[static_cast<size_t>(value)];
+        }
+
+        [[nodiscard]] uint64_t operator[](counter value) const noexcept
+        {
+            return values[static_cast<size_t>(value)];
+        }
+
+        // Sums everything except slowest_pass_ns, which takes the larger of the two
+        counters &operator+=(const counters &other) noexcept;
+
+        [[nodiscard]] uint64_t total_rays() const noexcept
+        {
+            return (*this)[counter::camera_rays] + (*this)[counter::bounce_rays] +
+              (*this)[counter::shadow_rays];
+        }
+
+        [[nodiscard]] double seconds(counter value) const noexcept
+        {
+            return static_cast<double>((*this)[value]) / 1'000'000'000.0;
+        }
+    };
+
+    /*
+     * Running totals for one tile. Only the worker currently holding the tile merges into it,
+     * so workers never contend on a counter, and the padding keeps neighbouring tiles off each
+     * other's cache lines. Readers sum every tile.
+     */
+    struct alignas(64) tile_counters
+    {
+        std::array<std::atomic<uint64_t>, counter_count> values {};
+
+        [[nodiscard]] uint64_t operator[](counter value) const noexcept
+        {
+            return values[static_cast<size_t>(value)].load(std::memory_order_relaxed);
+        }
+
+        void merge(const counters &pass) noexcept;
+
+        void reset() noexcept;
+
+        void add_to(counters &totals) const noexcept;
+    };
+
+    // Adds the time until it goes out of scope to a counter, does nothing when disabled
+    class scoped_timer
+    {
+    public:
+        scoped_timer(counters &target, counter value, bool enabled) noexcept
+            : _target(enabled ? &target : nullptr), _value(value)
+        {
+            if (_target) _start = std::chrono::steady_clock::now();
+        }
+
+        ~scoped_timer()
+        {
+            stop();
+        }
+
+        // Adds the time so far and stops counting, for stages that end before the scope does
+        void stop() noexcept
+        {
+            if (!_target) return;
+
+            const auto elapsed = std::chrono::steady_clock::now() - _start;
+            (*_target)[_value] +=
+              std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+            _target = nullptr;
+        }
+
+        scoped_timer(const scoped_timer &) = delete;
+
+        scoped_timer &operator=(const scoped_timer &) = delete;
+
+    private:
+        counters *                            _target;
+        counter                               _value;
+        std::chrono::steady_clock::time_point _start;
+    };
+
+    // Point in time values that go next to the counters in an export
+    struct gauge
+    {
+        std::string name;
+        std::string help;
+        double      value;
+    };
+
+    // OpenMetrics text exposition, every name gets a "crender_" prefix
+    [[nodiscard]] std::string
+      to_openmetrics(const counters &totals, const std::vector<gauge> &gauges);
+
+    [[nodiscard]] std::string to_json(const counters &totals, const std::vector<gauge> &gauges);
+
+    // Writes next to the target and renames over it, so a scraper never reads half a file
+    bool write_file(const std::string &path, const std::string &contents);
+}    // namespace cr::metrics
@@ -22,3 +22,10 @@ cr::ray cr::ray::transform(const glm::mat4 &matrix) const noexcept
 
     return cr::ray(transformed_origin, glm::normalize(transformed_direction));
 }
+
+cr::ray cr::ray_packet::get(size_t lane) const noexcept
+{
+    return cr::ray(
+      glm::vec3(origin_x[lane], origin_y[lane], origin_z[lane]),
+      glm::vec3(direction_x[lane], direction_y[lane], direction_z[lane]));
+}
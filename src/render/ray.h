@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #include <glm/glm.hpp>
 
 #include <render/material/material.h>
@@ -32,4 +34,25 @@ namespace cr
 
         [[nodiscard]] cr::ray transform(const glm::mat4 &matrix) const noexcept;
     };
+
+    /*
+     * Structure of arrays bundle of rays, matching the layout of Embree's 8 wide ray packets.
+     * Only the first `count` lanes are valid.
+     */
+    struct ray_packet
+    {
+        static constexpr auto size = size_t(8);
+
+        uint32_t count = 0;
+
+        std::array<float, size> origin_x;
+        std::array<float, size> origin_y;
+        std::array<float, size> origin_z;
+
+        std::array<float, size> direction_x;
+        std::array<float, size> direction_y;
+        std::array<float, size> direction_z;
+
+        [[nodiscard]] cr::ray get(size_t lane) const noexcept;
+    };
 }    // namespace cr
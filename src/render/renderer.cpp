@@ -3,25 +3,62 @@
 
 namespace
 {
-    [[nodiscard]] float randf() noexcept
+    using counter = cr::metrics::counter;
+
+    // A sample's dimensions are the camera jitter, then a fixed block per bounce so the same
+    // decision at the same depth always reads the same dimension of the sequence
+    constexpr auto camera_dimensions = 2u;
+    constexpr auto bounce_dimensions = 7u;    // BSDF direction, sun, skybox, roulette
+
+    // Seconds between checks of the image error against the error budget
+    constexpr auto convergence_interval = 0.05;
+
+    [[nodiscard]] constexpr uint32_t bounce_dimension(int bounce) noexcept
+    {
+        return camera_dimensions + static_cast<uint32_t>(bounce) * bounce_dimensions;
+    }
+
+    [[nodiscard]] float luminance(const glm::vec3 &colour) noexcept
+    {
+        return glm::dot(colour, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+    }
+
+    [[nodiscard]] glm::vec3 aov_value(const cr::aov_buffer &buffer, uint64_t x, uint64_t y)
+    {
+        auto rgba = glm::vec4();
+        buffer.decode(buffer.pixel(x, y), 1, &rgba.x);
+        return glm::vec3(rgba);
+    }
+
+    // Russian roulette, paths that can barely contribute any more are likely to be terminated.
+    // Survivors are divided by their survival probability so the estimate stays unbiased
+    [[nodiscard]] bool survives_roulette(glm::vec3 &throughput, float u) noexcept
     {
-        thread_local std::mt19937             gen;
-        std::uniform_real_distribution<float> dist(0.f, 1.f);
-        return dist(gen);
+        const auto survival = glm::clamp(luminance(throughput), 0.05f, 1.0f);
+        if (u >= survival) return false;
+
+        throughput /= survival;
+        return true;
     }
 
     struct processed_hit
     {
-        bool is_alpha = false;
         float     emission;
         glm::vec3 albedo;
         glm::vec4 colour;
+        glm::vec3 weight;    // BSDF times the cosine over the pdf, what the throughput takes on
+        glm::vec3 view;      // Back along the ray that hit
         cr::ray   ray;
+        float     pdf;    // Solid angle pdf of ray's direction, zero for a delta BSDF
     };
-    [[nodiscard]] processed_hit
-      process_hit(const cr::ray::intersection_record &record, const cr::ray &ray, cr::scene *scene)
+    [[nodiscard]] processed_hit process_hit(
+      const cr::ray::intersection_record &record,
+      const cr::ray &                     ray,
+      cr::scene *                         scene,
+      cr::sample_stream &                 stream)
     {
         auto out = processed_hit();
+        out.pdf  = 0.0f;
 
         // Calculate some "required" values
         const auto cos_theta = glm::abs(glm::dot(out.ray.direction, record.normal));
@@ -34,13 +71,9 @@ namespace
         else
             out.colour = record.material->info.colour;
 
-        if (out.colour.w == 0.0)
-        {
-            out.is_alpha = true;
-            return out;
-        }
-
         out.albedo = glm::vec3(out.colour);
+        out.weight = out.albedo;
+        out.view   = -ray.direction;
 
         switch (record.material->info.shade_type)
         {
@@ -78,29 +111,272 @@ namespace
         case cr::material::metal:
         {
             out.ray.origin = record.intersection_point + record.normal * 0.0001f;
-            auto hemp_samp = cr::sampling::hemp_cos(record.normal, glm::vec2(::randf(), ::randf()));
+            out.albedo *= record.material->info.reflectiveness;
 
-            out.ray.direction = glm::reflect(ray.direction, record.normal);
-            //            out.ray.direction = glm::normalize(
-            //              (out.ray.direction + record.material->info.roughness * hemp_samp) -
-            //              out.ray.origin);
+            const auto roughness = record.material->info.roughness;
+            const auto n_v       = glm::dot(record.normal, out.view);
+            if (cr::brdf::ggx_is_mirror(roughness) || n_v <= 0.0f)
+            {
+                out.ray.direction = glm::reflect(ray.direction, record.normal);
+                out.weight = cr::sampling::cook_torrence::specular_f(glm::abs(n_v), out.albedo);
+                break;
+            }
 
-            out.albedo *= record.material->info.reflectiveness;
-            // throughput *= brdf(out_dir, surface_properties, in_dir) * cos_theta / pdf
+            // A sample under the surface has no weight, the path ends here
+            const auto picked = cr::brdf::sample_ggx(
+              out.view,
+              record.normal,
+              roughness,
+              out.albedo,
+              stream.next_2d());
+            out.ray.direction = picked.direction;
+            out.weight        = picked.weight;
+            out.pdf           = picked.pdf;
             break;
         }
         case cr::material::smooth:
-            auto cos_hemp_dir =
-              cr::sampling::hemp_cos(record.normal, glm::vec2(::randf(), ::randf()));
+            auto cos_hemp_dir = cr::sampling::hemp_cos(record.normal, stream.next_2d());
 
             out.ray.origin    = record.intersection_point + record.normal * 0.0001f;
             out.ray.direction = glm::normalize(cos_hemp_dir);
+            out.pdf           = cr::sampling::hemp_cos_pdf(
+              glm::max(glm::dot(out.ray.direction, record.normal), 0.0f));
             break;
         }
 
         return out;
     }
 
+    [[nodiscard]] glm::vec3 sample_miss(cr::scene *scene, const glm::vec3 &direction)
+    {
+        const auto miss_uv = cr::environment_map::to_uv(direction);
+        return scene->sample_skybox(miss_uv.x, miss_uv.y);
+    }
+
+    // What a BSDF does to light arriving from a direction, for light sampling
+    struct bsdf_eval
+    {
+        glm::vec3 value;    // BSDF times the cosine
+        float     pdf;      // Of process_hit picking the same direction
+    };
+    [[nodiscard]] bsdf_eval evaluate_bsdf(
+      const cr::ray::intersection_record &record,
+      const processed_hit &               hit,
+      const glm::vec3 &                   direction)
+    {
+        const auto cosine = glm::dot(record.normal, direction);
+        if (cosine <= 0.0f) return { glm::vec3(0.0f), 0.0f };
+
+        switch (record.material->info.shade_type)
+        {
+        case cr::material::smooth:
+            return { hit.albedo * cr::numbers<float>::inv_pi * cosine,
+                     cr::sampling::hemp_cos_pdf(cosine) };
+        case cr::material::metal:
+        {
+            // Only rough metals get here, a mirror is a delta
+            const auto roughness = record.material->info.roughness;
+            return { cr::brdf::ggx(hit.view, direction, record.normal, roughness, hit.albedo),
+                     cr::brdf::ggx_pdf(hit.view, direction, record.normal, roughness) };
+        }
+        case cr::material::glass: break;
+        }
+
+        return { glm::vec3(0.0f), 0.0f };
+    }
+
+    /*
+     * Radiance a ray that left the scene brings back from the skybox and the sun. Both are also
+     * light sampled at non-delta hits, so a BSDF sampled ray only gets its MIS share. Camera
+     * rays and rays off a delta BSDF, with a bsdf_pdf of zero, are the only way to reach them.
+     */
+    [[nodiscard]] glm::vec3
+      miss_radiance(cr::scene *scene, const glm::vec3 &direction, float bsdf_pdf)
+    {
+        auto out = ::sample_miss(scene, direction);
+        if (bsdf_pdf > 0.0f)
+            out *= cr::sampling::power_heuristic(bsdf_pdf, scene->skybox_pdf(direction));
+
+        if (scene->is_sun_enabled())
+        {
+            const auto sun    = scene->registry()->sun();
+            const auto weight = bsdf_pdf > 0.0f
+              ? cr::sampling::power_heuristic(bsdf_pdf, cr::sampling::sun::pdf(direction, sun))
+              : 1.0f;
+            out += cr::sampling::sun::sky_colour(direction, sun) * weight;
+        }
+
+        return out;
+    }
+
+    struct light_sample
+    {
+        cr::ray   ray;
+        glm::vec3 radiance = glm::vec3(0.0f);    // BSDF, cosine, pdf and MIS weight applied,
+                                                 // zero if not worth a shadow ray
+    };
+    [[nodiscard]] light_sample sample_skybox_light(
+      cr::scene *                         scene,
+      const cr::ray::intersection_record &intersection,
+      const processed_hit &               hit,
+      const glm::vec2 &                   uv)
+    {
+        const auto picked = scene->sample_skybox_direction(uv);
+
+        auto out = light_sample();
+        out.ray  = cr::ray(
+          intersection.intersection_point + intersection.normal * 0.001f,
+          picked.direction);
+
+        const auto bsdf = ::evaluate_bsdf(intersection, hit, picked.direction);
+        if (bsdf.pdf == 0.0f || picked.pdf <= 0.0f) return out;
+
+        out.radiance = bsdf.value * ::sample_miss(scene, picked.direction) *
+          cr::sampling::power_heuristic(picked.pdf, bsdf.pdf) / picked.pdf;
+
+        return out;
+    }
+
+    [[nodiscard]] light_sample sample_sun(
+      cr::scene *                         scene,
+      const cr::ray::intersection_record &intersection,
+      const processed_hit &               hit,
+      const glm::vec2 &                   uv)
+    {
+        auto out = light_sample();
+        out.ray  = cr::ray(
+          intersection.intersection_point + intersection.normal * 0.001f,
+          glm::vec3(0.0f));
+
+        auto incoming          = cr::sampling::sun::incoming();
+        incoming.pos           = out.ray.origin;
+        incoming.normal        = intersection.normal;
+        incoming.sun_transform = scene->registry()->sun_transform();
+        incoming.sun           = scene->registry()->sun();
+
+        const auto pdf_cos = cr::sampling::sun::sample(incoming, uv);
+        out.ray.direction  = pdf_cos.dir;
+
+        // Facing away from the sun, there's no need for a shadow ray
+        const auto bsdf = ::evaluate_bsdf(intersection, hit, pdf_cos.dir);
+        if (bsdf.pdf == 0.0f) return out;
+
+        out.radiance = bsdf.value * cr::sampling::sun::sky_colour(pdf_cos.dir, incoming.sun) *
+          cr::sampling::power_heuristic(pdf_cos.pdf, bsdf.pdf) / pdf_cos.pdf;
+
+        return out;
+    }
+
+    // One sample of the sun and one of the skybox, each with its own dimensions of the bounce
+    [[nodiscard]] std::array<light_sample, 2> sample_lights(
+      cr::scene *                         scene,
+      const cr::ray::intersection_record &intersection,
+      const processed_hit &               hit,
+      cr::sample_stream &                 stream,
+      int                                 bounce)
+    {
+        auto out = std::array<light_sample, 2>();
+        if (scene->is_sun_enabled())
+        {
+            stream.skip_to(::bounce_dimension(bounce) + 2);
+            out[0] = ::sample_sun(scene, intersection, hit, stream.next_2d());
+        }
+
+        stream.skip_to(::bounce_dimension(bounce) + 4);
+        out[1] = ::sample_skybox_light(scene, intersection, hit, stream.next_2d());
+
+        return out;
+    }
+
+    [[nodiscard]] cr::image &frame_image(cr::renderer::frame &frame, cr::aov output) noexcept
+    {
+        switch (output)
+        {
+        case cr::aov::albedo: return frame.albedo;
+        case cr::aov::normals: return frame.normals;
+        case cr::aov::depth: return frame.depth;
+        case cr::aov::error: return frame.error;
+        }
+
+        return frame.error;
+    }
+
+    // Copies the pixels of [min, min + size) from one image to another of the same size
+    void copy_rectangle(
+      const cr::image & from,
+      cr::image &       to,
+      const glm::ivec2 &min,
+      const glm::ivec2 &size) noexcept
+    {
+        for (auto y = min.y; y < min.y + size.y; y++)
+            std::memcpy(
+              to.data() + (min.x + y * to.width()) * 4,
+              from.data() + (min.x + y * from.width()) * 4,
+              size.x * 4 * sizeof(float));
+    }
+
+    // A tile's version is odd while its buffers are being written, readers copy them without a
+    // lock and check the version again afterwards
+    void begin_tile_write(std::atomic<uint64_t> &version) noexcept
+    {
+        version.fetch_add(1, std::memory_order_relaxed);
+
+        // The writes that follow can't become visible before the odd version does
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void end_tile_write(std::atomic<uint64_t> &version) noexcept
+    {
+        version.fetch_add(1, std::memory_order_release);
+    }
+
+    // Whether what was copied since version was read belongs to that one version
+    [[nodiscard]] bool tile_copy_valid(const std::atomic<uint64_t> &version, uint64_t read) noexcept
+    {
+        // The copy's reads can't move past the check
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return version.load(std::memory_order_relaxed) == read;
+    }
+
+    // Per path state for the wavefront integrator, one entry per path in the batch
+    struct wavefront_paths
+    {
+        std::vector<cr::ray>   rays;
+        std::vector<glm::vec3> throughput;
+        std::vector<glm::vec3> radiance;
+        std::vector<glm::vec3> albedo;
+        std::vector<glm::vec3> normal;
+        std::vector<float>     depth;
+        std::vector<float>     bsdf_pdf;    // Of the ray each path traces next
+
+        // Indices of the paths still alive, compacted after every bounce
+        std::vector<uint32_t> active;
+        std::vector<uint32_t> next_active;
+
+        // Rays of the live paths packed together for tracing, and their hits
+        std::vector<cr::ray>                      stream;
+        std::vector<cr::ray::intersection_record> hits;
+
+        std::vector<cr::ray>   shadow_rays;
+        std::vector<uint32_t>  shadow_paths;
+        std::vector<glm::vec3> shadow_radiance;
+        std::vector<uint8_t>   shadow_occluded;
+
+        void reset(size_t count)
+        {
+            rays.resize(count);
+            throughput.assign(count, glm::vec3(1.0f));
+            radiance.assign(count, glm::vec3(0.0f));
+            albedo.assign(count, glm::vec3(0.0f));
+            normal.assign(count, glm::vec3(0.0f));
+            depth.assign(count, 0.0f);
+            bsdf_pdf.assign(count, 0.0f);
+
+            active.clear();
+            next_active.clear();
+        }
+    };
+
 }    // namespace
 
 cr::renderer::renderer(
@@ -109,36 +385,79 @@ cr::renderer::renderer(
   const uint64_t                    bounces,
   std::unique_ptr<cr::thread_pool> *pool,
   std::unique_ptr<cr::scene> *      scene)
-    : _camera(scene->get()->registry()->camera()), _buffer(res_x, res_y), _normals(res_x, res_y),
-      _albedo(res_x, res_y), _depth(res_x, res_y), _res_x(res_x), _res_y(res_y),
-      _max_bounces(bounces), _thread_pool(pool), _scene(scene), _raw_buffer(res_x * res_y * 3)
+    : _camera(scene->get()->registry()->camera()), _res_x(res_x), _res_y(res_y),
+      _max_bounces(bounces), _thread_pool(pool), _scene(scene), _raw_buffer(res_x * res_y * 4),
+      _moment_buffer(res_x * res_y)
 {
+    _aspect_correction = static_cast<float>(_res_x) / _res_y;
+    _sampler           = cr::sampler::create(_sampler_type);
+    _build_tiles();
+
     _management_thread = std::thread([this]() {
         while (_run_management)
         {
-            const auto tasks = _get_tasks();
-
-            if (!tasks.empty() && (_current_sample < _spp_target || _spp_target == 0))
+            if (!_pause && _needs_samples())
             {
-                _thread_pool->get()->wait_on_tasks(tasks);
-                _current_sample++;
+                // The coarse levels go first so something shows long before the first full pass
+                if (_preview_pending.exchange(false))
+                    for (const auto block_size : { 4, 2 })
+                        if (!_pause)
+                            _thread_pool->get()->parallel_for(
+                              static_cast<uint32_t>(_tiles.size()),
+                              [this, block_size](uint32_t index)
+                              { _preview_tile(index, block_size); });
+
+                _reschedule = false;
+
+                // The region of interest catches up first, a zero target stays unlimited
+                const auto priority = _priority_tiles();
+                if (!priority.empty())
+                {
+                    const auto target = _spp_target.load();
+                    auto       limit  = uint64_t(0);
+                    {
+                        auto guard = std::unique_lock(_interest_mutex);
+                        limit      = target == 0 ? _interest_samples
+                                                 : glm::min(_interest_samples, target);
+                    }
+
+                    _thread_pool->get()->parallel_repeat(
+                      static_cast<uint32_t>(priority.size()),
+                      [this, &priority, limit](uint32_t i)
+                      { return _render_tile(priority[i], limit); });
+                }
+
+                // Tiles keep feeding themselves back into the pool until they hit the target
+                // or the renderer is paused, there's no sync point between samples
+                _thread_pool->get()->parallel_repeat(
+                  static_cast<uint32_t>(_tiles.size()),
+                  [this](uint32_t index) { return _render_tile(index, _spp_target.load()); });
             }
             else
             {
-                if (_current_sample == _spp_target && _current_sample != 0)
+                if (!_pause && !_needs_samples())
                     cr::logger::info(
-                      "Finished rendering [{}] samples at resolution [X: {}, Y: {}], took: [{}]s",
-                      _spp_target,
+                      "Finished rendering [{}] samples at resolution [X: {}, Y: {}], stopped by "
+                      "the [{}] limit, took: [{}]s",
+                      current_sample_count(),
                       _res_x,
                       _res_y,
+                      render_eta::name(_stopped_by()),
                       _timer.time_since_start());
 
                 {
                     auto guard = std::unique_lock(_pause_mutex);
-                    _pause_cond_var.notify_one();
+                    _idle      = true;
+                    _pause_cond_var.notify_all();
                 }
                 auto guard = std::unique_lock(_start_mutex);
-                _start_cond_var.wait(guard);
+                _start_cond_var.wait(
+                  guard,
+                  [this]
+                  {
+                      return !_run_management || (!_pause && _needs_samples());
+                  });
+                _idle = false;
             }
         }
     });
@@ -147,7 +466,11 @@ cr::renderer::renderer(
 cr::renderer::~renderer()
 {
     _run_management = false;
-    start();    // if we're paused, start it up again
+    {
+        // Wake the management thread whether it's paused or has finished its target
+        auto guard = std::unique_lock(_start_mutex);
+        _start_cond_var.notify_all();
+    }
     _management_thread.join();
 }
 
@@ -155,15 +478,42 @@ bool cr::renderer::start()
 {
     if (_pause)
     {
-        _pause = false;
-        _buffer.clear();
         _timer.reset();
-        for (auto i = 0; i < _res_x * _res_y * 3; i++) _raw_buffer[i] = 0.0f;
-        _current_sample = 0;
-        _total_rays     = 0;
 
-        auto guard = std::unique_lock(_start_mutex);
-        _start_cond_var.notify_all();
+        // Snapshots can be taken meanwhile, every tile is being written until this is done
+        for (auto i = 0; i < _tiles.size(); i++) ::begin_tile_write(_tile_version[i]);
+        if (!_reproject())
+        {
+            for (auto i = 0; i < _res_x * _res_y * 4; i++) _raw_buffer[i] = 0.0f;
+            for (auto i = 0; i < _res_x * _res_y; i++) _moment_buffer[i] = 0.0f;
+        }
+        if (_history_depth.allocated()) _history_camera = *_camera;
+        if (!_preview_buffer.empty())
+        {
+            std::fill(_preview_buffer.begin(), _preview_buffer.end(), 0.0f);
+            _preview_pending = true;
+        }
+
+        for (auto i = 0; i < _tiles.size(); i++) _tile_progress[i] = 0;
+        for (auto i = 0; i < _tiles.size(); i++) _tile_retired[i] = false;
+        for (auto i = 0; i < _tiles.size(); i++) _tile_counters[i].reset();
+        for (auto i = 0; i < _tiles.size(); i++)
+            _tile_error_estimate[i] = std::numeric_limits<float>::infinity();
+        _error_reached = false;
+        for (auto i = 0; i < _tiles.size(); i++) ::end_tile_write(_tile_version[i]);
+
+        {
+            auto eta_guard = std::unique_lock(_eta_mutex);
+            _convergence.clear();
+        }
+
+        {
+            // The buffers were cleared, every tile has to be captured again
+            auto snapshot_guard = std::unique_lock(_snapshot_mutex);
+            for (auto &buffer : _snapshot_buffers) buffer.versions.clear();
+        }
+
+        _resume();
         return true;
     }
     return false;
@@ -175,13 +525,163 @@ bool cr::renderer::pause()
     {
         _pause = true;
 
+        // Also returns straight away if the management thread already finished its target
         auto guard = std::unique_lock(_pause_mutex);
-        _pause_cond_var.wait(guard);
+        _pause_cond_var.wait(guard, [this] { return _idle.load(); });
         return true;
     }
     return false;
 }
 
+void cr::renderer::set_aov_enabled(cr::aov output, bool enabled)
+{
+    auto &buffer = _aovs[static_cast<size_t>(output)];
+    if (buffer.allocated() == enabled) return;
+
+    // Workers write straight into the buffers, so they can only be swapped while paused. Unlike
+    // update this carries on with the samples so far. A finished render has no passes left to
+    // fill the AOV in, so it's filled here
+    const auto paused_here = pause();
+    {
+        // Snapshots copy the AOVs without pausing, so the storage is only swapped under their lock
+        auto guard = std::unique_lock(_snapshot_mutex);
+        buffer = enabled ? cr::aov_buffer::create(output, _res_x, _res_y) : cr::aov_buffer();
+    }
+    if (enabled) _fill_aov(output);
+    if (paused_here) _resume();
+}
+
+void cr::renderer::set_reprojection(bool enabled, uint32_t max_history)
+{
+    _max_history = static_cast<float>(max_history);
+    if (_history_depth.allocated() == enabled) return;
+
+    // Written by the workers like the AOVs. Pixels without a first hit yet have a depth of zero,
+    // which never matches, so the current camera can be the history straight away
+    const auto paused_here = pause();
+    if (enabled)
+    {
+        _history_depth   = cr::aov_buffer::create(cr::aov::depth, _res_x, _res_y);
+        _history_normals = cr::aov_buffer::create(cr::aov::normals, _res_x, _res_y);
+        _history_camera  = *_camera;
+    }
+    else
+    {
+        _history_depth   = cr::aov_buffer();
+        _history_normals = cr::aov_buffer();
+        _history_camera.reset();
+    }
+    if (paused_here) _resume();
+}
+
+void cr::renderer::set_progressive_preview(bool enabled)
+{
+    if (_preview_buffer.empty() != enabled) return;
+
+    // Read by snapshots between passes, so like the AOVs it's only swapped while paused
+    const auto paused_here = pause();
+    {
+        auto guard      = std::unique_lock(_snapshot_mutex);
+        _preview_buffer = enabled ? std::vector<float>(_res_x * _res_y * 4) : std::vector<float>();
+    }
+    if (paused_here) _resume();
+}
+
+bool cr::renderer::aov_enabled(cr::aov output) const noexcept
+{
+    return _aovs[static_cast<size_t>(output)].allocated();
+}
+
+void cr::renderer::_resume()
+{
+    _pause = false;
+
+    auto guard = std::unique_lock(_start_mutex);
+    _start_cond_var.notify_all();
+}
+
+bool cr::renderer::_reproject()
+{
+    if (!_history_camera) return false;
+
+    const auto &previous = *_history_camera;
+    const auto  moved    = previous.mat4() != _camera->mat4() || previous.fov != _camera->fov ||
+      previous.scale != _camera->scale || previous.current_mode != _camera->current_mode;
+    if (!moved) return false;
+
+    // Snapshots may still be copying out of the accumulation, so it's rewritten in place rather
+    // than swapped for new storage. start() marks every tile as written until this is done
+    const auto old_raw     = _raw_buffer;
+    const auto old_moments = _moment_buffer;
+    const auto old_depth   = std::move(_history_depth);
+    const auto old_normals = std::move(_history_normals);
+    std::fill(_raw_buffer.begin(), _raw_buffer.end(), 0.0f);
+    std::fill(_moment_buffer.begin(), _moment_buffer.end(), 0.0f);
+    _history_depth   = cr::aov_buffer::create(cr::aov::depth, _res_x, _res_y);
+    _history_normals = cr::aov_buffer::create(cr::aov::normals, _res_x, _res_y);
+
+    // A ray through each pixel centre finds what the pixel sees now, and where that was on the
+    // previous screen. The history there is only trusted if it saw the same surface
+    auto kept = std::atomic<uint64_t>(0);
+    _thread_pool->get()->parallel_for(
+      _res_y,
+      [this, &previous, &old_raw, &old_moments, &old_depth, &old_normals, &kept](uint32_t y)
+      {
+          auto kept_row = uint64_t(0);
+          for (auto x = 0; x < _res_x; x++)
+          {
+              const auto ray = _camera->get_ray(
+                (static_cast<float>(x) + 0.5f) / _res_x,
+                (static_cast<float>(y) + 0.5f) / _res_y,
+                _aspect_correction);
+              const auto hit = _scene->get()->cast_ray(ray);
+              if (hit.distance == std::numeric_limits<float>::infinity()) continue;
+
+              // Same flip as _accumulate
+              const auto flipped_x = _res_x - 1 - x;
+              const auto flipped_y = _res_y - 1 - y;
+              const auto pixel     = flipped_x + flipped_y * _res_x;
+              _history_depth.set(flipped_x, flipped_y, glm::vec3(hit.distance));
+              _history_normals.set(flipped_x, flipped_y, hit.normal);
+
+              const auto screen = previous.project(ray.at(hit.distance), _aspect_correction);
+              if (!screen) continue;
+
+              const auto resolution = glm::ivec2(_res_x, _res_y);
+              const auto old = glm::ivec2(glm::floor(glm::vec2(*screen) * glm::vec2(resolution)));
+              if (glm::any(glm::lessThan(old, glm::ivec2(0))) ||
+                  glm::any(glm::greaterThanEqual(old, resolution)))
+                  continue;
+
+              const auto old_x     = _res_x - 1 - old.x;
+              const auto old_y     = _res_y - 1 - old.y;
+              const auto old_pixel = old_x + old_y * _res_x;
+              const auto count     = old_raw[old_pixel * 4 + 3];
+
+              // A depth of zero is a miss or a pixel that hasn't been sampled since enabling
+              const auto old_distance = ::aov_value(old_depth, old_x, old_y).x;
+              const auto same_depth   = old_distance > 0.0f &&
+                glm::abs(old_distance - screen->z) <= 0.05f * screen->z;
+              const auto same_normal =
+                glm::dot(::aov_value(old_normals, old_x, old_y), hit.normal) > 0.9f;
+              if (count == 0.0f || !same_depth || !same_normal) continue;
+
+              // Scaled down so the history counts as at most max_history samples
+              const auto weight = glm::min(1.0f, _max_history / count);
+              for (auto c = 0; c < 4; c++)
+                  _raw_buffer[pixel * 4 + c] = old_raw[old_pixel * 4 + c] * weight;
+              _moment_buffer[pixel] = old_moments[old_pixel] * weight;
+              kept_row++;
+          }
+          kept += kept_row;
+      });
+
+    cr::logger::info(
+      "Reprojected [{:.1f}]% of the pixels",
+      100.0 * static_cast<double>(kept.load()) / (static_cast<double>(_res_x) * _res_y));
+    return true;
+}
+
 void cr::renderer::update(const std::function<void()> &update)
 {
     pause();
@@ -193,18 +693,32 @@ void cr::renderer::update(const std::function<void()> &update)
 
 void cr::renderer::set_resolution(int x, int y)
 {
+    // Everything snapshot reads is reallocated, its lock keeps a running one off the old storage
+    auto guard = std::unique_lock(_snapshot_mutex);
+
     _res_x = x;
     _res_y = y;
 
     _aspect_correction = static_cast<float>(_res_x) / _res_y;
 
-    _buffer  = cr::image(x, y);
-    _normals = cr::image(x, y);
-    _depth   = cr::image(x, y);
-    _albedo  = cr::image(x, y);
+    for (auto i = 0; i < cr::aov_count; i++)
+        if (_aovs[i].allocated())
+            _aovs[i] = cr::aov_buffer::create(static_cast<cr::aov>(i), x, y);
+
+    if (!_preview_buffer.empty()) _preview_buffer = std::vector<float>(x * y * 4);
+
+    // Pixels don't line up with the old resolution, there's nothing to reproject from
+    if (_history_depth.allocated())
+    {
+        _history_depth   = cr::aov_buffer::create(cr::aov::depth, x, y);
+        _history_normals = cr::aov_buffer::create(cr::aov::normals, x, y);
+        _history_camera.reset();
+    }
+
+    _raw_buffer    = std::vector<float>(x * y * 4);
+    _moment_buffer = std::vector<float>(x * y);
 
-    _raw_buffer     = std::vector<float>(x * y * 3);
-    _current_sample = 0;
+    _build_tiles();
 }
 
 void cr::renderer::set_max_bounces(int bounces)
@@ -215,190 +729,1296 @@ void cr::renderer::set_max_bounces(int bounces)
 void cr::renderer::set_target_spp(uint64_t target)
 {
     _spp_target = target;
+
+    // Raising the target on a finished render should carry on sampling
+    auto guard = std::unique_lock(_start_mutex);
+    _start_cond_var.notify_all();
 }
 
-cr::image *cr::renderer::current_progress() noexcept
+void cr::renderer::set_budget(const render_budget &budget)
 {
-    return &_buffer;
+    _time_budget  = glm::max(budget.seconds, 0.0);
+    _error_budget = glm::max(budget.error, 0.0f);
+
+    // A lower error limit might not be met any more, the next pass checks again
+    _error_reached = false;
+
+    set_target_spp(budget.samples);
 }
 
-cr::image *cr::renderer::current_normals() noexcept
+cr::renderer::render_budget cr::renderer::budget() const noexcept
 {
-    return &_normals;
+    return { _time_budget.load(), _spp_target.load(), _error_budget.load() };
 }
 
-cr::image *cr::renderer::current_albedos() noexcept
+bool cr::renderer::finished() const noexcept
 {
-    return &_albedo;
+    return !_needs_samples();
 }
 
-cr::image *cr::renderer::current_depths() noexcept
+void cr::renderer::set_tile_size(int x, int y)
 {
-    return &_depth;
+    auto guard = std::unique_lock(_snapshot_mutex);
+    _tile_size = glm::max(glm::ivec2(x, y), glm::ivec2(1, 1));
+    _build_tiles();
 }
 
-std::vector<std::function<void()>> cr::renderer::_get_tasks()
+void cr::renderer::set_tile_samples(uint64_t samples)
 {
-    auto tasks = std::vector<std::function<void()>>();
+    _tile_samples = glm::max(samples, uint64_t(1));
+}
 
-    if (_pause) return tasks;
+void cr::renderer::set_sample_range(uint64_t first, uint64_t count)
+{
+    _first_sample = first;
+    set_target_spp(count);
+}
 
-    tasks.reserve(_res_y);
+void cr::renderer::set_region(const glm::ivec2 &min, const glm::ivec2 &max)
+{
+    auto guard  = std::unique_lock(_snapshot_mutex);
+    _region_min = glm::max(min, glm::ivec2(0, 0));
+    _region_max = glm::max(max, _region_min);
+    _build_tiles();
+}
 
-    for (auto y = 0; y < _res_y; y++)
-        tasks.emplace_back([this, y] {
-            auto fired_rays = size_t(0);
-            for (auto x = 0; x < _res_x; x++) this->_sample_pixel(x, y, fired_rays);
-            _total_rays += fired_rays;
-        });
+void cr::renderer::set_region_of_interest(
+  const glm::ivec2 &min,
+  const glm::ivec2 &max,
+  uint64_t          samples)
+{
+    {
+        auto guard        = std::unique_lock(_interest_mutex);
+        _interest_min     = min;
+        _interest_max     = max;
+        _interest_samples = samples;
+    }
 
-    return tasks;
+    // The passes running now were scheduled for the old region, the management thread starts
+    // over with the new one
+    _reschedule = true;
 }
 
-void cr::renderer::_sample_pixel(uint64_t x, uint64_t y, size_t &fired_rays)
+void cr::renderer::set_integrator(integrator type)
 {
-    auto ray = _camera->get_ray(
-      (static_cast<float>(x) + ::randf()) / _res_x,
-      (static_cast<float>(y) + ::randf()) / _res_y,
-      _aspect_correction);
+    _integrator = type;
+}
 
-    auto throughput = glm::vec3(1.0f, 1.0f, 1.0f);
-    auto final      = glm::vec3(0.0f, 0.0f, 0.0f);
-    auto albedo     = glm::vec3(0.0f, 0.0f, 0.0f);
-    auto normal     = glm::vec3(0.0f, 0.0f, 0.0f);
-    auto depth      = 0.0f;
+void cr::renderer::set_sampler(cr::sampler::type type)
+{
+    _sampler_type = type;
+    _sampler      = cr::sampler::create(type);
+}
 
-    auto total_bounces = 1;
-    for (auto i = 0; i < _max_bounces; i++, total_bounces++)
-    {
-        auto intersection  = _scene->get()->cast_ray(ray);
-        auto processed_hit = ::processed_hit();
+void cr::renderer::set_russian_roulette(bool enabled, int min_depth)
+{
+    _roulette_enabled = enabled;
+    _roulette_depth   = glm::max(min_depth, 1);
+}
 
-        if (intersection.distance == std::numeric_limits<float>::infinity())
-        {
-            const auto miss_uv = glm::vec2(
-              0.5f + atan2f(ray.direction.z, ray.direction.x)*(cr::numbers<float>::inv_tau),
-              0.5f - asinf(ray.direction.y) * cr::numbers<float>::inv_pi);
+void cr::renderer::set_profiling(bool enabled)
+{
+    _profiling = enabled;
+}
 
-            const auto miss_sample = _scene->get()->sample_skybox(miss_uv.x, miss_uv.y);
+void cr::renderer::set_adaptive_sampling(float error_threshold, uint64_t min_samples)
+{
+    _error_threshold  = glm::max(error_threshold, 0.0f);
+    _adaptive_min_spp = glm::max(min_samples, uint64_t(2));
+}
 
-            if (i == 0) albedo = miss_sample;
+std::shared_ptr<const cr::renderer::frame> cr::renderer::snapshot()
+{
+    auto guard = std::unique_lock(_snapshot_mutex);
 
-            final += throughput * miss_sample;
-            break;
-        }
-        else
+    constexpr auto invalid = std::numeric_limits<uint64_t>::max();
+
+    auto aovs = std::array<bool, cr::aov_count>();
+    for (auto i = 0; i < cr::aov_count; i++) aovs[i] = _aovs[i].allocated();
+
+    auto &front = _snapshot_buffers[_snapshot_front];
+    auto &back  = _snapshot_buffers[1 - _snapshot_front];
+
+    const auto same_size = front.snapshot && front.snapshot->colour.width() == _res_x &&
+      front.snapshot->colour.height() == _res_y && _snapshot_aovs == aovs;
+    if (!same_size)
+    {
+        _snapshot_aovs = aovs;
+        for (auto &buffer : _snapshot_buffers) buffer.snapshot.reset();
+    }
+    for (auto &buffer : _snapshot_buffers)
+        if (!buffer.snapshot || buffer.versions.size() != _tiles.size())
         {
-            processed_hit = ::process_hit(intersection, ray, _scene->get());
+            buffer.versions.assign(_tiles.size(), invalid);
+            buffer.samples.assign(_tiles.size(), 0);
+        }
 
-            if (processed_hit.is_alpha)
-            {
-                auto point = intersection.intersection_point; // We need to offset by the inverse normal
-                auto offset_point = point + ray.direction * 0.1f;
+    auto changed = false;
+    for (auto i = 0; i < _tiles.size() && !changed; i++)
+        changed = front.versions[i] != _tile_version[i].load();
+    if (!changed && front.snapshot) return front.snapshot;
 
-                ray.origin = offset_point;
-                continue;
-            }
+    // Readers only ever hold the front, the back is brought up to date in place and swapped in.
+    // One that's still held elsewhere is left to its holder and replaced by a copy of the front
+    if (!back.snapshot || (back.snapshot.use_count() != 1 && !front.snapshot))
+    {
+        auto next    = std::make_shared<frame>();
+        next->colour = cr::image(_res_x, _res_y);
+        for (auto i = 0; i < cr::aov_count; i++)
+            if (aovs[i]) ::frame_image(*next, static_cast<cr::aov>(i)) = cr::image(_res_x, _res_y);
+
+        back.snapshot = std::move(next);
+        back.versions.assign(_tiles.size(), invalid);
+        back.samples.assign(_tiles.size(), 0);
+    }
+    else if (back.snapshot.use_count() != 1)
+    {
+        back.snapshot = std::make_shared<frame>(*front.snapshot);
+        back.versions = front.versions;
+        back.samples  = front.samples;
+    }
 
-            if (i == 0)
-            {
-                albedo = processed_hit.albedo;
-                normal = intersection.normal;
-                depth  = intersection.distance;
-            }
+    const auto target = _spp_target.load();
+    for (auto i = uint32_t(0); i < _tiles.size(); i++)
+    {
+        const auto version = _tile_version[i].load();
+        if (version == back.versions[i]) continue;
 
-            throughput *= processed_hit.albedo;
-            final += throughput * processed_hit.emission;
-            ray = processed_hit.ray;
+        // Progress and retirement are only written inside a pass, so they match the pixels
+        const auto progress = _tile_progress[i].load();
+        const auto reached  = _tile_retired[i] ? glm::max(progress, target) : progress;
+
+        if (version % 2 == 0 && _capture_tile(i, version, *back.snapshot))
+        {
+            back.versions[i] = version;
+            back.samples[i]  = reached;
+            continue;
         }
 
-        // Sun NEE
-        if (_scene->get()->is_sun_enabled()) {
-            auto out_ray = cr::ray(
-              intersection.intersection_point + intersection.normal * 0.001f,
-              glm::vec3(0.0f));
+        // Mid pass, the front holds the newest finished pass of the tile
+        const auto front_version = front.versions[i];
+        if (!front.snapshot || front_version == invalid || front_version == back.versions[i])
+            continue;
+
+        const auto &tile = _tiles[i];
+        const auto  min  = glm::ivec2(_res_x, _res_y) - tile.max;
+        const auto  size = tile.max - tile.min;
+        ::copy_rectangle(front.snapshot->colour, back.snapshot->colour, min, size);
+        for (auto a = 0; a < cr::aov_count; a++)
+            if (aovs[a])
+                ::copy_rectangle(
+                  ::frame_image(*front.snapshot, static_cast<cr::aov>(a)),
+                  ::frame_image(*back.snapshot, static_cast<cr::aov>(a)),
+                  min,
+                  size);
+
+        back.versions[i] = front.versions[i];
+        back.samples[i]  = front.samples[i];
+    }
 
-            auto sample          = cr::sampling::sun::incoming();
-            sample.pos           = out_ray.origin;
-            sample.normal        = intersection.normal;
-            sample.sun_transform = _scene->get()->registry()->sun_transform();
-            sample.sun           = _scene->get()->registry()->sun();
+    const auto fewest = std::min_element(back.samples.begin(), back.samples.end());
+    back.snapshot->samples   = fewest == back.samples.end() ? 0 : *fewest;
+    back.snapshot->timestamp = _timer.time_since_start();
 
-            const auto pdf_cos = cr::sampling::sun::sample(sample);
-            out_ray.direction  = pdf_cos.dir;
+    _snapshot_front = 1 - _snapshot_front;
+    return back.snapshot;
+}
 
-            auto sun_intersection = _scene->get()->cast_ray(out_ray);
-            if (sun_intersection.distance != std::numeric_limits<float>::infinity())
-            {
-                auto processed_intersection = ::process_hit(sun_intersection, ray, _scene->get());
+bool cr::renderer::save_checkpoint(const std::string &path, bool compress)
+{
+    auto checkpoint         = cr::checkpoint::state();
+    checkpoint.fingerprint  = _fingerprint();
+    checkpoint.width        = _res_x;
+    checkpoint.height       = _res_y;
+    checkpoint.tile_width   = _tile_size.x;
+    checkpoint.tile_height  = _tile_size.y;
+    checkpoint.tile_samples = _tile_samples;
+    checkpoint.sampler      = static_cast<uint32_t>(_sampler_type);
+    checkpoint.elapsed      = _timer.time_since_start();
+    checkpoint.first_sample = _first_sample;
+    std::tie(checkpoint.region_min, checkpoint.region_max) = _clipped_region();
+    checkpoint.raw.resize(_raw_buffer.size());
+    checkpoint.moments.resize(_moment_buffer.size());
+    checkpoint.progress.resize(_tiles.size());
+    checkpoint.retired.resize(_tiles.size());
+    checkpoint.counters.resize(_tiles.size() * cr::metrics::counter_count);
+
+    // Tiles between passes are copied while the render carries on, the rest once it's paused
+    auto busy = std::vector<uint32_t>();
+    for (auto i = uint32_t(0); i < _tiles.size(); i++)
+        if (!_checkpoint_tile(i, checkpoint)) busy.push_back(i);
+
+    if (!busy.empty())
+    {
+        const auto paused_here = pause();
+        for (const auto i : busy) static_cast<void>(_checkpoint_tile(i, checkpoint));
+        if (paused_here) _resume();
+    }
 
-                while (sun_intersection.distance != std::numeric_limits<float>::infinity() && processed_intersection.is_alpha)
-                {
-                    out_ray.origin = sun_intersection.intersection_point + out_ray.direction * 0.1f;
-                    sun_intersection = _scene->get()->cast_ray(out_ray);
+    if (!cr::checkpoint::write(path, checkpoint, compress)) return false;
 
-                    if (sun_intersection.distance == std::numeric_limits<float>::infinity())
-                        break;
+    cr::logger::info(
+      "Saved checkpoint [{}] at [{}] samples, [{}]s in",
+      path,
+      current_sample_count(),
+      checkpoint.elapsed);
+    return true;
+}
 
-                    processed_intersection = ::process_hit(sun_intersection, ray, _scene->get());
-                }
-            }
+bool cr::renderer::load_checkpoint(const std::string &path)
+{
+    const auto checkpoint = cr::checkpoint::read(path);
+    if (!checkpoint) return false;
+
+    if (checkpoint->width != _res_x || checkpoint->height != _res_y)
+    {
+        cr::logger::error(
+          "Checkpoint [{}] is [X: {}, Y: {}], the render is [X: {}, Y: {}]",
+          path,
+          checkpoint->width,
+          checkpoint->height,
+          _res_x,
+          _res_y);
+        return false;
+    }
+
+    if (checkpoint->fingerprint != _fingerprint())
+    {
+        cr::logger::error("Checkpoint [{}] was taken of a different scene or camera", path);
+        return false;
+    }
 
+    // Partial renders of one frame share a fingerprint, carrying on needs the same part
+    const auto [region_min, region_max] = _clipped_region();
+    if (checkpoint->first_sample != _first_sample || checkpoint->region_min != region_min ||
+        checkpoint->region_max != region_max)
+    {
+        cr::logger::error("Checkpoint [{}] covers a different sample range or region", path);
+        return false;
+    }
+
+    // Workers write straight into the buffers and progress, so like set_aov_enabled this swaps
+    // them while paused and carries on instead of starting over
+    pause();
 
-            if (sun_intersection.distance == std::numeric_limits<float>::infinity())
-                final += throughput * glm::vec3(processed_hit.colour) * pdf_cos.cosine *
-                  cr::sampling::sun::sky_colour(
-                           out_ray.direction,
-                           _scene->get()->registry()->sun()) /
-                  pdf_cos.pdf;
+    {
+        // Snapshots read the tiles and buffers without pausing, they wait for the swap instead
+        auto snapshot_guard = std::unique_lock(_snapshot_mutex);
+
+        _tile_size    = glm::ivec2(checkpoint->tile_width, checkpoint->tile_height);
+        _tile_samples = checkpoint->tile_samples;
+        _build_tiles();
+        set_sampler(static_cast<cr::sampler::type>(checkpoint->sampler));
+
+        _raw_buffer    = checkpoint->raw;
+        _moment_buffer = checkpoint->moments;
+        for (auto i = 0; i < _tiles.size(); i++)
+        {
+            _tile_progress[i] = checkpoint->progress[i];
+            _tile_retired[i]  = checkpoint->retired[i] != 0;
+
+            auto counters = cr::metrics::counters();
+            std::copy_n(
+              checkpoint->counters.begin() + i * cr::metrics::counter_count,
+              cr::metrics::counter_count,
+              counters.values.begin());
+            _tile_counters[i].reset();
+            _tile_counters[i].merge(counters);
         }
+
+        std::fill(_preview_buffer.begin(), _preview_buffer.end(), 0.0f);
+        for (auto &buffer : _snapshot_buffers) buffer.versions.clear();
     }
-    fired_rays += total_bounces;
 
-    // flip Y
-    y = _res_y - 1 - y;
-    x = _res_x - 1 - x;
+    _timer.reset(checkpoint->elapsed);
+    _error_reached = false;
+    {
+        auto eta_guard = std::unique_lock(_eta_mutex);
+        _convergence.clear();
+    }
 
-    const auto base_index = (x + y * _res_x) * 3;
-    _raw_buffer[base_index + 0] += final.x;
-    _raw_buffer[base_index + 1] += final.y;
-    _raw_buffer[base_index + 2] += final.z;
-
-    _albedo.set(x, y, albedo);
-    _normals.set(x, y, normal * .5f + .5f);
-    _depth.set(x, y, glm::vec3(glm::min(depth, 200.0f) / 200.f));    // 200.f is the "far" plane.
-
-    _buffer.set(
-      x,
-      y,
-      glm::vec3(
-        glm::pow(
-          glm::clamp(_raw_buffer[base_index + 0] / float(_current_sample + 1), 0.0f, 1.0f),
-          1.f / 2.2f),
-        glm::pow(
-          glm::clamp(_raw_buffer[base_index + 1] / float(_current_sample + 1), 0.0f, 1.0f),
-          1.f / 2.2f),
-        glm::pow(
-          glm::clamp(_raw_buffer[base_index + 2] / float(_current_sample + 1), 0.0f, 1.0f),
-          1.f / 2.2f)));
+    cr::logger::info(
+      "Resumed from checkpoint [{}] at [{}] samples, [{}]s in",
+      path,
+      current_sample_count(),
+      checkpoint->elapsed);
+
+    _resume();
+    return true;
 }
 
-glm::ivec2 cr::renderer::current_resolution() const noexcept
+std::pair<glm::ivec2, glm::ivec2> cr::renderer::_clipped_region() const noexcept
 {
-    return { _res_x, _res_y };
+    const auto resolution = glm::ivec2(_res_x, _res_y);
+
+    const auto min = glm::min(_region_min, resolution);
+    const auto max = glm::min(_region_max, resolution);
+    if (glm::any(glm::lessThanEqual(max, min))) return { glm::ivec2(0, 0), resolution };
+
+    return { min, max };
 }
 
-uint64_t cr::renderer::current_sample_count() const noexcept
+void cr::renderer::resolve(const float *sums, size_t count, float *rgba) noexcept
 {
-    return _current_sample.load();
+    // Branch free over contiguous floats so the compiler can vectorise it
+    constexpr auto inv_gamma = 1.0f / 2.2f;
+    for (auto i = size_t(0); i < count; i++)
+    {
+        const auto *sum     = sums + i * 4;
+        const auto  mean    = glm::vec3(sum[0], sum[1], sum[2]) / glm::max(sum[3], 1.0f);
+        const auto  display = glm::pow(
+          glm::clamp(mean, glm::vec3(0.0f), glm::vec3(1.0f)),
+          glm::vec3(inv_gamma));
+
+        rgba[i * 4 + 0] = display.r;
+        rgba[i * 4 + 1] = display.g;
+        rgba[i * 4 + 2] = display.b;
+        rgba[i * 4 + 3] = 1.0f;
+    }
+}
+
+void cr::renderer::_build_tiles()
+{
+    // Tiles stay on the same grid whatever the region, the ones on its edge are cut down
+    const auto [region_min, region_max] = _clipped_region();
+    const auto first_tile = region_min / _tile_size;
+    const auto last_tile  = (region_max + _tile_size - 1) / _tile_size;
+
+    _tiles.clear();
+    _tiles.reserve((last_tile.x - first_tile.x) * (last_tile.y - first_tile.y));
+
+    for (auto y = first_tile.y; y < last_tile.y; y++)
+        for (auto x = first_tile.x; x < last_tile.x; x++)
+        {
+            auto current = tile();
+            current.min  = glm::max(glm::ivec2(x, y) * _tile_size, region_min);
+            current.max  = glm::min(glm::ivec2(x + 1, y + 1) * _tile_size, region_max);
+            _tiles.push_back(current);
+        }
+
+    _tile_progress       = std::make_unique<std::atomic<uint64_t>[]>(_tiles.size());
+    _tile_retired        = std::make_unique<std::atomic<bool>[]>(_tiles.size());
+    _tile_version        = std::make_unique<std::atomic<uint64_t>[]>(_tiles.size());
+    _tile_counters       = std::make_unique<cr::metrics::tile_counters[]>(_tiles.size());
+    _tile_error_estimate = std::make_unique<std::atomic<float>[]>(_tiles.size());
+    for (auto i = 0; i < _tiles.size(); i++) _tile_progress[i] = 0;
+    for (auto i = 0; i < _tiles.size(); i++) _tile_retired[i] = false;
+    for (auto i = 0; i < _tiles.size(); i++) _tile_version[i] = 0;
+    for (auto i = 0; i < _tiles.size(); i++)
+        _tile_error_estimate[i] = std::numeric_limits<float>::infinity();
+}
+
+void cr::renderer::_preview_tile(uint32_t index, int block_size)
+{
+    const auto &tile     = _tiles[index];
+    auto        counters = cr::metrics::counters();
+
+    // Written like a pass, snapshots never see a tile halfway through a level
+    ::begin_tile_write(_tile_version[index]);
+
+    for (auto y = tile.min.y; y < tile.max.y; y += block_size)
+        for (auto x = tile.min.x; x < tile.max.x; x += block_size)
+        {
+            const auto corner = glm::ivec2(x, y);
+            const auto block  = glm::min(corner + block_size, tile.max) - corner;
+            const auto centre = glm::vec2(corner) + glm::vec2(block) * 0.5f;
+
+            const auto ray =
+              _camera->get_ray(centre.x / _res_x, centre.y / _res_y, _aspect_correction);
+            auto hit = cr::ray::intersection_record();
+            {
+                const auto timer =
+                  cr::metrics::scoped_timer(counters, counter::trace_ns, _profiling);
+                hit = _scene->get()->cast_ray(ray);
+            }
+            counters[counter::camera_rays]++;
+
+            const auto path = _trace_path(
+              cr::sample_stream(*_sampler, glm::uvec2(corner), _first_sample, ::camera_dimensions),
+              ray,
+              hit,
+              counters);
+
+            // Nearest neighbour, the whole block shows the one path
+            for (auto block_y = y; block_y < y + block.y; block_y++)
+                for (auto block_x = x; block_x < x + block.x; block_x++)
+                {
+                    // Same flip as _accumulate
+                    const auto pixel = (_res_x - 1 - block_x) + (_res_y - 1 - block_y) * _res_x;
+                    _preview_buffer[pixel * 4 + 0] = path.radiance.x;
+                    _preview_buffer[pixel * 4 + 1] = path.radiance.y;
+                    _preview_buffer[pixel * 4 + 2] = path.radiance.z;
+                    _preview_buffer[pixel * 4 + 3] = 1.0f;
+                }
+        }
+
+    _tile_counters[index].merge(counters);
+    ::end_tile_write(_tile_version[index]);
+}
+
+void cr::renderer::_fill_aov(cr::aov output)
+{
+    _thread_pool->get()->parallel_for(
+      static_cast<uint32_t>(_tiles.size()),
+      [this, output](uint32_t index)
+      {
+          const auto &tile = _tiles[index];
+          ::begin_tile_write(_tile_version[index]);
+
+          if (output == cr::aov::error)
+              static_cast<void>(_tile_error(tile));
+          else
+              for (auto y = tile.min.y; y < tile.max.y; y++)
+                  for (auto x = tile.min.x; x < tile.max.x; x++)
+                  {
+                      const auto ray = _camera->get_ray(
+                        (static_cast<float>(x) + 0.5f) / _res_x,
+                        (static_cast<float>(y) + 0.5f) / _res_y,
+                        _aspect_correction);
+                      const auto hit = _scene->get()->cast_ray(ray);
+
+                      // Same as the first bounce of _trace_path
+                      auto albedo = glm::vec3(0.0f);
+                      auto normal = glm::vec3(0.0f);
+                      auto depth  = 0.0f;
+                      if (hit.distance == std::numeric_limits<float>::infinity())
+                          albedo = ::sample_miss(_scene->get(), ray.direction);
+                      else
+                      {
+                          auto stream = cr::sample_stream(
+                            *_sampler,
+                            glm::uvec2(x, y),
+                            _first_sample,
+                            ::bounce_dimension(0));
+                          albedo = ::process_hit(hit, ray, _scene->get(), stream).albedo;
+                          normal = hit.normal;
+                          depth  = hit.distance;
+                      }
+
+                      _store_first_hit(_res_x - 1 - x, _res_y - 1 - y, albedo, normal, depth);
+                  }
+
+          ::end_tile_write(_tile_version[index]);
+      });
+}
+
+bool cr::renderer::_render_tile(uint32_t index, uint64_t target)
+{
+    if (_pause || !_run_management || _error_reached || _reschedule) return false;
+
+    // Every restart of the scheduling queues all tiles again, converged ones stay done
+    if (_tile_retired[index]) return false;
+
+    const auto first_sample = _tile_progress[index].load();
+    if (target != 0 && first_sample >= target) return false;
+
+    const auto samples =
+      target == 0 ? _tile_samples : glm::min(_tile_samples, target - first_sample);
+    if (!_fits_time_budget(index, samples)) return false;
+    const auto &tile     = _tiles[index];
+    auto        counters = cr::metrics::counters();
+
+    // Snapshots leave the tile alone until the pass is done
+    ::begin_tile_write(_tile_version[index]);
+
+    // Alpha filters run inside Embree, they count per thread and the pass stays on this one
+    const auto alpha_skips = cr::scene::alpha_skips();
+    {
+        const auto timer = cr::metrics::scoped_timer(counters, counter::pass_ns, true);
+
+        // Progress counts this render's samples, the sampler wants their index in the frame
+        const auto first_index = _first_sample + first_sample;
+        if (_integrator == integrator::wavefront)
+            _trace_wavefront(tile, first_index, samples, counters);
+        else
+            for (auto sample = first_index; sample < first_index + samples; sample++)
+                _trace_packets(tile, sample, sample == first_index, counters);
+    }
+    counters[counter::alpha_skips]     = cr::scene::alpha_skips() - alpha_skips;
+    counters[counter::passes]          = 1;
+    counters[counter::slowest_pass_ns] = counters[counter::pass_ns];
+    _tile_counters[index].merge(counters);
+
+    const auto progress   = first_sample + samples;
+    _tile_progress[index] = progress;
+
+    // The variance needs at least two samples
+    auto retire = false;
+    if (progress >= 2)
+    {
+        const auto error = _tile_error(tile);
+        retire           = _error_threshold > 0.0f && progress >= _adaptive_min_spp &&
+          error < _error_threshold;
+
+        _tile_error_estimate[index] = error;
+    }
+    if (retire) _tile_retired[index] = true;
+
+    // Both walk every tile, after every pass they'd make a sample cost O(tiles^2) between them
+    const auto error_budget = _error_budget.load();
+    if (error_budget > 0.0f && _claim_convergence_check())
+    {
+        _record_convergence();
+        if (progress >= _adaptive_min_spp && _image_error() < error_budget) _error_reached = true;
+    }
+
+    ::end_tile_write(_tile_version[index]);
+
+    return !retire && !_error_reached && (target == 0 || progress < target);
+}
+
+std::vector<uint32_t> cr::renderer::_priority_tiles()
+{
+    auto guard = std::unique_lock(_interest_mutex);
+
+    auto out = std::vector<uint32_t>();
+    if (_interest_samples == 0 || glm::any(glm::lessThanEqual(_interest_max, _interest_min)))
+        return out;
+
+    for (auto i = uint32_t(0); i < _tiles.size(); i++)
+    {
+        const auto &tile = _tiles[i];
+        if (_tile_retired[i]) continue;
+
+        if (glm::all(glm::lessThan(tile.min, _interest_max)) &&
+            glm::all(glm::greaterThan(tile.max, _interest_min)))
+            out.push_back(i);
+    }
+    return out;
+}
+
+float cr::renderer::_tile_error(const tile &tile)
+{
+    auto &error_aov = _aovs[static_cast<size_t>(cr::aov::error)];
+
+    auto total = 0.0f;
+    for (auto y = tile.min.y; y < tile.max.y; y++)
+        for (auto x = tile.min.x; x < tile.max.x; x++)
+        {
+            // Same flip as _accumulate
+            const auto flipped_x = _res_x - 1 - x;
+            const auto flipped_y = _res_y - 1 - y;
+            const auto pixel     = flipped_x + flipped_y * _res_x;
+
+            // Per pixel rather than the tile's progress, reprojected history adds to some pixels
+            const auto n = glm::max(_raw_buffer[pixel * 4 + 3], 2.0f);
+            const auto mean = ::luminance(glm::vec3(
+                                _raw_buffer[pixel * 4 + 0],
+                                _raw_buffer[pixel * 4 + 1],
+                                _raw_buffer[pixel * 4 + 2])) /
+              n;
+            const auto variance =
+              glm::max(_moment_buffer[pixel] / n - mean * mean, 0.0f) * n / (n - 1.0f);
+
+            // Standard error of the mean relative to the mean, the offset keeps black pixels from
+            // dividing by zero
+            const auto error = glm::sqrt(variance / n) / (mean + 0.01f);
+
+            if (error_aov.allocated()) error_aov.set(flipped_x, flipped_y, glm::vec3(error));
+            total += error;
+        }
+
+    const auto size = tile.max - tile.min;
+    return total / static_cast<float>(size.x * size.y);
+}
+
+void cr::renderer::_trace_packets(
+  const tile &tile,
+  uint64_t    sample,
+  bool                    first_of_pass,
+  cr::metrics::counters &counters)
+{
+    auto packet_x = std::array<float, cr::ray_packet::size>();
+    auto packet_y = std::array<float, cr::ray_packet::size>();
+    auto hits     = std::array<cr::ray::intersection_record, cr::ray_packet::size>();
+
+    // Camera rays from neighbouring pixels are coherent, so they're traced together as a packet.
+    // Everything after the first hit goes down the scalar path.
+    for (auto y = tile.min.y; y < tile.max.y; y++)
+        for (auto x = tile.min.x; x < tile.max.x; x += cr::ray_packet::size)
+        {
+            const auto count =
+              static_cast<uint32_t>(glm::min<int>(cr::ray_packet::size, tile.max.x - x));
+
+            for (auto lane = 0; lane < cr::ray_packet::size; lane++)
+            {
+                const auto jitter = _sampler->get_2d(glm::uvec2(x + lane, y), sample, 0);
+
+                packet_x[lane] = (static_cast<float>(x + lane) + jitter.x) / _res_x;
+                packet_y[lane] = (static_cast<float>(y) + jitter.y) / _res_y;
+            }
+
+            const auto packet =
+              _camera->get_ray_packet(packet_x, packet_y, count, _aspect_correction);
+            {
+                const auto timer =
+                  cr::metrics::scoped_timer(counters, counter::trace_ns, _profiling);
+                _scene->get()->cast_ray_packet(packet, hits);
+            }
+            counters[counter::camera_rays] += count;
+
+            for (auto lane = 0; lane < count; lane++)
+            {
+                const auto pixel = glm::uvec2(x + lane, y);
+                const auto path  = _trace_path(
+                  cr::sample_stream(*_sampler, pixel, sample, ::camera_dimensions),
+                  packet.get(lane),
+                  hits[lane],
+                  counters);
+
+                const auto timer =
+                  cr::metrics::scoped_timer(counters, counter::accumulate_ns, _profiling);
+                _accumulate(
+                  pixel.x,
+                  pixel.y,
+                  first_of_pass,
+                  path.radiance,
+                  path.albedo,
+                  path.normal,
+                  path.depth);
+            }
+        }
+}
+
+void cr::renderer::_trace_wavefront(
+  const tile &tile,
+  uint64_t    first_sample,
+  uint64_t               samples,
+  cr::metrics::counters &counters)
+{
+    thread_local auto paths = ::wavefront_paths();
+
+    auto *     scene       = _scene->get();
+    const auto size        = tile.max - tile.min;
+    const auto pixel_count = static_cast<size_t>(size.x) * size.y;
+    const auto path_count  = pixel_count * samples;
+
+    // Every sample of every pixel in the tile is one path in the batch
+    const auto path_pixel = [&tile, &size, pixel_count](uint32_t path)
+    {
+        const auto pixel = path % pixel_count;
+        return glm::uvec2(tile.min.x + pixel % size.x, tile.min.y + pixel / size.x);
+    };
+    const auto path_sample = [first_sample, pixel_count](uint32_t path)
+    { return first_sample + path / pixel_count; };
+
+    paths.reset(path_count);
+    for (auto path = uint32_t(0); path < path_count; path++)
+    {
+        const auto pixel  = path_pixel(path);
+        const auto jitter = _sampler->get_2d(pixel, path_sample(path), 0);
+
+        paths.rays[path] = _camera->get_ray(
+          (static_cast<float>(pixel.x) + jitter.x) / _res_x,
+          (static_cast<float>(pixel.y) + jitter.y) / _res_y,
+          _aspect_correction);
+        paths.active.push_back(path);
+    }
+
+    for (auto bounce = 0; bounce < _max_bounces && !paths.active.empty(); bounce++)
+    {
+        // Trace kernel, every live path in one stream
+        paths.stream.clear();
+        for (const auto path : paths.active) paths.stream.push_back(paths.rays[path]);
+        {
+            const auto timer = cr::metrics::scoped_timer(counters, counter::trace_ns, _profiling);
+            scene->cast_ray_stream(paths.stream, paths.hits);
+        }
+        counters[bounce == 0 ? counter::camera_rays : counter::bounce_rays] += paths.active.size();
+
+        // Shade kernel, dead paths are compacted out of the active list
+        paths.next_active.clear();
+        paths.shadow_rays.clear();
+        paths.shadow_paths.clear();
+        paths.shadow_radiance.clear();
+
+        // Killing a path on its last bounce would only add noise
+        const auto roulette = _roulette_enabled && bounce + 1 < _max_bounces;
+        auto       shading  = cr::metrics::scoped_timer(counters, counter::shade_ns, _profiling);
+
+        for (auto i = 0; i < paths.active.size(); i++)
+        {
+            const auto  path = paths.active[i];
+            const auto &hit  = paths.hits[i];
+            auto &      ray  = paths.rays[path];
+
+            if (hit.distance == std::numeric_limits<float>::infinity())
+            {
+                counters[counter::misses]++;
+
+                const auto miss_sample = ::sample_miss(scene, ray.direction);
+                if (bounce == 0) paths.albedo[path] = miss_sample;
+
+                paths.radiance[path] += paths.throughput[path] *
+                  ::miss_radiance(scene, ray.direction, paths.bsdf_pdf[path]);
+                continue;
+            }
+
+            auto stream = cr::sample_stream(
+              *_sampler,
+              path_pixel(path),
+              path_sample(path),
+              ::bounce_dimension(bounce));
+
+            const auto processed = ::process_hit(hit, ray, scene, stream);
+
+            if (bounce == 0)
+            {
+                paths.albedo[path] = processed.albedo;
+                paths.normal[path] = hit.normal;
+                paths.depth[path]  = hit.distance;
+            }
+
+            if (processed.pdf > 0.0f)
+            {
+                const auto lights = ::sample_lights(scene, hit, processed, stream, bounce);
+                for (const auto &light : lights)
+                {
+                    if (light.radiance == glm::vec3(0.0f)) continue;
+
+                    paths.shadow_rays.push_back(light.ray);
+                    paths.shadow_paths.push_back(path);
+                    paths.shadow_radiance.push_back(paths.throughput[path] * light.radiance);
+                }
+            }
+
+            paths.throughput[path] *= processed.weight;
+            paths.radiance[path] += paths.throughput[path] * processed.emission;
+            ray                   = processed.ray;
+            paths.bsdf_pdf[path]  = processed.pdf;
+
+            // Nothing is left to carry light, like a rough metal reflecting under its surface
+            if (paths.throughput[path] == glm::vec3(0.0f)) continue;
+
+            if (roulette && bounce + 1 >= _roulette_depth)
+            {
+                stream.skip_to(::bounce_dimension(bounce) + 6);
+
+                if (!::survives_roulette(paths.throughput[path], stream.next_1d()))
+                {
+                    counters[counter::roulette_kills]++;
+                    continue;
+                }
+            }
+
+            paths.next_active.push_back(path);
+        }
+        shading.stop();
+
+        // Shadow kernel, visibility only
+        {
+            const auto timer = cr::metrics::scoped_timer(counters, counter::trace_ns, _profiling);
+            scene->occluded_stream(
+              paths.shadow_rays,
+              std::numeric_limits<float>::infinity(),
+              paths.shadow_occluded);
+        }
+        counters[counter::shadow_rays] += paths.shadow_rays.size();
+
+        for (auto i = 0; i < paths.shadow_rays.size(); i++)
+            if (!paths.shadow_occluded[i])
+                paths.radiance[paths.shadow_paths[i]] += paths.shadow_radiance[i];
+
+        std::swap(paths.active, paths.next_active);
+    }
+
+    const auto timer = cr::metrics::scoped_timer(counters, counter::accumulate_ns, _profiling);
+    for (auto path = uint32_t(0); path < path_count; path++)
+    {
+        const auto pixel = path_pixel(path);
+
+        _accumulate(
+          pixel.x,
+          pixel.y,
+          path < pixel_count,
+          paths.radiance[path],
+          paths.albedo[path],
+          paths.normal[path],
+          paths.depth[path]);
+    }
+}
+
+bool cr::renderer::_needs_samples() const noexcept
+{
+    if (_error_reached) return false;
+
+    const auto target = _spp_target.load();
+    for (auto i = uint32_t(0); i < _tiles.size(); i++)
+    {
+        const auto progress = _tile_progress[i].load();
+        if (_tile_retired[i] || (target != 0 && progress >= target)) continue;
+
+        // Once no tile can fit another pass in, waiting for one would only spin
+        const auto samples =
+          target == 0 ? _tile_samples : glm::min(_tile_samples, target - progress);
+        if (_fits_time_budget(i, samples)) return true;
+    }
+
+    return false;
+}
+
+bool cr::renderer::_fits_time_budget(uint32_t index, uint64_t samples) const noexcept
+{
+    const auto limit = _time_budget.load();
+    if (limit <= 0.0) return true;
+
+    // Passes of one tile cost about the same per sample, a tile that hasn't run yet is free
+    const auto taken      = static_cast<double>(_tile_progress[index].load());
+    const auto pass_time  = static_cast<double>(_tile_counters[index][counter::pass_ns]);
+    const auto per_sample = taken == 0.0 ? 0.0 : pass_time / 1'000'000'000.0 / taken;
+
+    return _timer.time_since_start() + per_sample * static_cast<double>(samples) < limit;
+}
+
+float cr::renderer::_image_error() const noexcept
+{
+    if (_tiles.empty()) return std::numeric_limits<float>::infinity();
+
+    auto total = 0.0f;
+    for (auto i = 0; i < _tiles.size(); i++) total += _tile_error_estimate[i].load();
+
+    return total / static_cast<float>(_tiles.size());
+}
+
+bool cr::renderer::_claim_convergence_check() noexcept
+{
+    // The timer goes back to zero on start, a check from before that doesn't hold this one up
+    const auto now  = _timer.time_since_start();
+    auto       last = _convergence_checked.load();
+    if (now >= last && now - last < ::convergence_interval) return false;
+
+    return _convergence_checked.compare_exchange_strong(last, now);
+}
+
+void cr::renderer::_record_convergence()
+{
+    const auto error = static_cast<double>(_image_error());
+    if (!std::isfinite(error) || error <= 0.0) return;
+
+    auto samples = 0.0;
+    for (auto i = 0; i < _tiles.size(); i++) samples += static_cast<double>(_tile_progress[i]);
+    samples /= static_cast<double>(_tiles.size());
+
+    // Spaced by samples, so the history looks the same however often the ETA is asked for
+    auto guard = std::unique_lock(_eta_mutex);
+    if (_convergence.empty() || samples > _convergence.back().first * 1.1)
+        _convergence.emplace_back(samples, error);
+}
+
+cr::renderer::render_eta::limit cr::renderer::_stopped_by() const noexcept
+{
+    if (_error_reached) return render_eta::limit::error;
+
+    const auto target = _spp_target.load();
+    for (auto i = 0; i < _tiles.size(); i++)
+        if (!_tile_retired[i] && (target == 0 || _tile_progress[i] < target))
+            return render_eta::limit::time;
+
+    return render_eta::limit::samples;
+}
+
+cr::renderer::path_sample cr::renderer::_trace_path(
+  cr::sample_stream                   stream,
+  cr::ray                             ray,
+  const cr::ray::intersection_record &camera_hit,
+  cr::metrics::counters &             counters)
+{
+    auto throughput = glm::vec3(1.0f, 1.0f, 1.0f);
+    auto final      = glm::vec3(0.0f, 0.0f, 0.0f);
+    auto albedo     = glm::vec3(0.0f, 0.0f, 0.0f);
+    auto normal     = glm::vec3(0.0f, 0.0f, 0.0f);
+    auto depth      = 0.0f;
+    auto bsdf_pdf   = 0.0f;    // Of the ray being traced, camera rays count as a delta
+
+    for (auto i = 0; i < _max_bounces; i++)
+    {
+        auto intersection  = camera_hit;
+        auto processed_hit = ::processed_hit();
+
+        // Light sampling at the hit goes through the surface's BSDF but not its albedo
+        const auto hit_throughput = throughput;
+
+        if (i != 0)
+        {
+            const auto timer = cr::metrics::scoped_timer(counters, counter::trace_ns, _profiling);
+            intersection     = _scene->get()->cast_ray(ray);
+            counters[counter::bounce_rays]++;
+        }
+
+        if (intersection.distance == std::numeric_limits<float>::infinity())
+        {
+            counters[counter::misses]++;
+
+            const auto miss_sample = ::sample_miss(_scene->get(), ray.direction);
+
+            if (i == 0) albedo = miss_sample;
+
+            final += throughput * ::miss_radiance(_scene->get(), ray.direction, bsdf_pdf);
+            break;
+        }
+        else
+        {
+            const auto timer = cr::metrics::scoped_timer(counters, counter::shade_ns, _profiling);
+
+            stream.skip_to(::bounce_dimension(i));
+            processed_hit = ::process_hit(intersection, ray, _scene->get(), stream);
+
+            if (i == 0)
+            {
+                albedo = processed_hit.albedo;
+                normal = intersection.normal;
+                depth  = intersection.distance;
+            }
+
+            throughput *= processed_hit.weight;
+            final += throughput * processed_hit.emission;
+            ray      = processed_hit.ray;
+            bsdf_pdf = processed_hit.pdf;
+        }
+
+        // Light sampling, a delta BSDF would never line up with the sampled direction
+        if (processed_hit.pdf > 0.0f)
+        {
+            auto shading = cr::metrics::scoped_timer(counters, counter::shade_ns, _profiling);
+            const auto lights =
+              ::sample_lights(_scene->get(), intersection, processed_hit, stream, i);
+            shading.stop();
+
+            for (const auto &light : lights)
+            {
+                if (light.radiance == glm::vec3(0.0f)) continue;
+
+                auto occluded = false;
+                {
+                    const auto timer =
+                      cr::metrics::scoped_timer(counters, counter::trace_ns, _profiling);
+                    occluded = _scene->get()->occluded(light.ray);
+                }
+                counters[counter::shadow_rays]++;
+
+                if (!occluded) final += hit_throughput * light.radiance;
+            }
+        }
+
+        // Nothing is left to carry light, like a rough metal reflecting under its surface
+        if (throughput == glm::vec3(0.0f)) break;
+
+        if (_roulette_enabled && i + 1 >= _roulette_depth && i + 1 < _max_bounces)
+        {
+            stream.skip_to(::bounce_dimension(i) + 6);
+
+            if (!::survives_roulette(throughput, stream.next_1d()))
+            {
+                counters[counter::roulette_kills]++;
+                break;
+            }
+        }
+    }
+
+    return { final, albedo, normal, depth };
+}
+
+void cr::renderer::_accumulate(
+  uint64_t         x,
+  uint64_t         y,
+  bool             first_of_pass,
+  const glm::vec3 &radiance,
+  const glm::vec3 &albedo,
+  const glm::vec3 &normal,
+  float            depth)
+{
+    // flip Y
+    y = _res_y - 1 - y;
+    x = _res_x - 1 - x;
+
+    // Only sums here, dividing and gamma correcting is left to snapshot
+    const auto pixel = x + y * _res_x;
+    _raw_buffer[pixel * 4 + 0] += radiance.x;
+    _raw_buffer[pixel * 4 + 1] += radiance.y;
+    _raw_buffer[pixel * 4 + 2] += radiance.z;
+    _raw_buffer[pixel * 4 + 3] += 1.0f;
+
+    const auto brightness = ::luminance(radiance);
+    _moment_buffer[pixel] += brightness * brightness;
+
+    // The first hit only moves by the camera jitter, one sample per pass is plenty for the AOVs
+    if (first_of_pass) _store_first_hit(x, y, albedo, normal, depth);
+}
+
+void cr::renderer::_store_first_hit(
+  uint64_t         x,
+  uint64_t         y,
+  const glm::vec3 &albedo,
+  const glm::vec3 &normal,
+  float            depth)
+{
+    auto &albedo_aov  = _aovs[static_cast<size_t>(cr::aov::albedo)];
+    auto &normals_aov = _aovs[static_cast<size_t>(cr::aov::normals)];
+    auto &depth_aov   = _aovs[static_cast<size_t>(cr::aov::depth)];
+
+    if (albedo_aov.allocated()) albedo_aov.set(x, y, albedo);
+    if (normals_aov.allocated()) normals_aov.set(x, y, normal);
+    if (depth_aov.allocated())
+        depth_aov.set(x, y, glm::vec3(glm::min(depth, 200.0f) / 200.f));    // 200.f is the "far" plane.
+
+    if (_history_depth.allocated())
+    {
+        _history_depth.set(x, y, glm::vec3(depth));
+        _history_normals.set(x, y, normal);
+    }
+}
+
+bool cr::renderer::_capture_tile(uint32_t index, uint64_t version, frame &out)
+{
+    // The buffers are stored flipped, so the tile covers the mirrored rectangle
+    const auto &tile = _tiles[index];
+    const auto  min  = glm::ivec2(_res_x, _res_y) - tile.max;
+    const auto  size = tile.max - tile.min;
+
+    const auto colour_row = static_cast<size_t>(size.x) * 4 * sizeof(float);
+    auto       scratch_size = colour_row * size.y;
+    for (const auto &buffer : _aovs) scratch_size += buffer.pixel_size() * size.x * size.y;
+
+    // Copy everything out first, if the tile changed meanwhile the copy is thrown away
+    _capture_scratch.resize(scratch_size);
+    auto *scratch = _capture_scratch.data();
+    for (auto y = 0; y < size.y; y++, scratch += colour_row)
+    {
+        const auto first = (min.x + (min.y + y) * _res_x) * 4;
+        std::memcpy(scratch, _raw_buffer.data() + first, colour_row);
+        if (_preview_buffer.empty()) continue;
+
+        // Pixels without samples of their own show the preview until they get some
+        auto *row = reinterpret_cast<float *>(scratch);
+        for (auto x = 0; x < size.x; x++)
+            if (row[x * 4 + 3] == 0.0f)
+                std::memcpy(row + x * 4, _preview_buffer.data() + first + x * 4, 4 * sizeof(float));
+    }
+
+    for (const auto &buffer : _aovs)
+    {
+        const auto row = buffer.pixel_size() * size.x;
+        for (auto y = 0; y < size.y && row != 0; y++, scratch += row)
+            std::memcpy(scratch, buffer.pixel(min.x, min.y + y), row);
+    }
+
+    if (!::tile_copy_valid(_tile_version[index], version)) return false;
+
+    scratch = _capture_scratch.data();
+    for (auto y = 0; y < size.y; y++, scratch += colour_row)
+    {
+        resolve(
+          reinterpret_cast<const float *>(scratch),
+          size.x,
+          out.colour.data() + (min.x + (min.y + y) * _res_x) * 4);
+    }
+
+    for (auto i = 0; i < cr::aov_count; i++)
+    {
+        const auto &buffer = _aovs[i];
+        const auto  row    = buffer.pixel_size() * size.x;
+        if (row == 0) continue;
+
+        auto &image = ::frame_image(out, static_cast<cr::aov>(i));
+        for (auto y = 0; y < size.y; y++, scratch += row)
+        {
+            auto *pixels = image.data() + (min.x + (min.y + y) * _res_x) * 4;
+            buffer.decode(scratch, size.x, pixels);
+
+            // Normals are stored as unit vectors, the frame has them in [0, 1] like before
+            if (static_cast<cr::aov>(i) == cr::aov::normals)
+                for (auto x = 0; x < size.x * 4; x++)
+                    if (x % 4 != 3) pixels[x] = pixels[x] * .5f + .5f;
+        }
+    }
+
+    return true;
+}
+
+bool cr::renderer::_checkpoint_tile(uint32_t index, cr::checkpoint::state &out)
+{
+    const auto version = _tile_version[index].load();
+    if (version % 2 != 0) return false;
+
+    // Mirrored like in _capture_tile
+    const auto &tile = _tiles[index];
+    const auto  min  = glm::ivec2(_res_x, _res_y) - tile.max;
+    const auto  size = tile.max - tile.min;
+
+    for (auto y = min.y; y < min.y + size.y; y++)
+    {
+        const auto row = static_cast<size_t>(min.x + y * _res_x);
+        std::memcpy(
+          out.raw.data() + row * 4,
+          _raw_buffer.data() + row * 4,
+          size.x * 4 * sizeof(float));
+        std::memcpy(out.moments.data() + row, _moment_buffer.data() + row, size.x * sizeof(float));
+    }
+
+    out.progress[index] = _tile_progress[index].load();
+    out.retired[index]  = _tile_retired[index] ? 1 : 0;
+    for (auto i = 0; i < cr::metrics::counter_count; i++)
+        out.counters[index * cr::metrics::counter_count + i] =
+          _tile_counters[index][static_cast<cr::metrics::counter>(i)];
+
+    return ::tile_copy_valid(_tile_version[index], version);
+}
+
+uint64_t cr::renderer::_fingerprint()
+{
+    // Only what changes the converged image, the sampler and tile layout are restored instead
+    auto out = cr::checkpoint::fingerprint();
+    out.add(_scene->get()->fingerprint());
+    out.add(_camera->position);
+    out.add(_camera->rotation);
+    out.add(_camera->fov);
+    out.add(_camera->current_mode);
+    out.add(_res_x);
+    out.add(_res_y);
+    out.add(_max_bounces.load());
+    return out.value();
+}
+
+glm::ivec2 cr::renderer::current_resolution() const noexcept
+{
+    return { _res_x, _res_y };
+}
+
+uint64_t cr::renderer::current_sample_count() const noexcept
+{
+    if (_tiles.empty()) return 0;
+
+    // Retired tiles are as good as finished
+    auto minimum = std::numeric_limits<uint64_t>::max();
+    for (auto i = 0; i < _tiles.size(); i++)
+    {
+        const auto progress = _tile_progress[i].load();
+        const auto reached  = _tile_retired[i] ? glm::max(progress, _spp_target.load()) : progress;
+        minimum             = glm::min(minimum, reached);
+    }
+    return minimum;
+}
+
+const char *cr::renderer::render_eta::name(limit value) noexcept
+{
+    switch (value)
+    {
+    case limit::none: return "none";
+    case limit::time: return "time";
+    case limit::samples: return "samples";
+    case limit::error: return "error";
+    }
+
+    return "none";
+}
+
+cr::renderer::render_eta cr::renderer::current_eta() const
+{
+    using limit = render_eta::limit;
+
+    constexpr auto infinity = std::numeric_limits<double>::infinity();
+
+    auto eta = render_eta { infinity, limit::none, _image_error() };
+    if (_tiles.empty()) return eta;
+
+    if (!_needs_samples())
+    {
+        eta.seconds  = 0.0;
+        eta.limiting = _stopped_by();
+        return eta;
+    }
+
+    const auto target = _spp_target.load();
+
+    auto pass_seconds = 0.0;
+    auto taken        = 0.0;    // Tile samples so far
+    auto remaining    = 0.0;    // Tile samples left to the target
+    auto active       = 0.0;
+    for (auto i = 0; i < _tiles.size(); i++)
+    {
+        const auto progress = _tile_progress[i].load();
+        pass_seconds += static_cast<double>(_tile_counters[i][counter::pass_ns]) / 1'000'000'000.0;
+        taken += static_cast<double>(progress);
+
+        if (_tile_retired[i]) continue;
+        active++;
+        if (target != 0 && progress < target) remaining += static_cast<double>(target - progress);
+    }
+
+    // Passes are timed on the worker, so with every worker busy the wall clock moves at a
+    // fraction of the summed pass time
+    const auto workers = glm::clamp(
+      static_cast<double>(_thread_pool->get()->thread_count()),
+      1.0,
+      glm::max(active, 1.0));
+    const auto cost = [&](double tile_samples)
+    {
+        if (tile_samples <= 0.0) return 0.0;
+        if (taken == 0.0) return infinity;
+        return tile_samples * pass_seconds / taken / workers;
+    };
+
+    const auto consider = [&eta](limit which, double seconds)
+    {
+        if (eta.limiting != limit::none && seconds >= eta.seconds) return;
+        eta.seconds  = glm::max(seconds, 0.0);
+        eta.limiting = which;
+    };
+
+    const auto time_budget = _time_budget.load();
+    if (time_budget > 0.0) consider(limit::time, time_budget - _timer.time_since_start());
+
+    if (target != 0) consider(limit::samples, cost(remaining));
+
+    const auto error_budget = static_cast<double>(_error_budget.load());
+    const auto samples      = taken / static_cast<double>(_tiles.size());
+    if (error_budget > 0.0)
+    {
+        const auto error = static_cast<double>(eta.error);
+
+        // Monte Carlo error falls with the square root of the samples, adaptive sampling and
+        // fireflies bend that, so the rate is measured once there's enough history
+        auto slope = -0.5;
+        {
+            auto guard = std::unique_lock(_eta_mutex);
+
+            // Against the latest point with at most half the samples, closer points are mostly
+            // noise in the error estimate
+            for (auto it = _convergence.rbegin(); it != _convergence.rend(); ++it)
+                if (it->first <= samples * 0.5 && it->second > error)
+                {
+                    slope = std::log(error / it->second) / std::log(samples / it->first);
+                    slope = glm::clamp(slope, -1.0, -0.25);
+                    break;
+                }
+        }
+
+        if (std::isfinite(error) && error > 0.0)
+        {
+            const auto needed = samples * std::pow(error_budget / error, 1.0 / slope);
+            consider(limit::error, cost(glm::max(needed - samples, 0.0) * active));
+        }
+        else
+            consider(limit::error, infinity);
+    }
+
+    return eta;
 }
 
 cr::renderer::renderer_stats cr::renderer::current_stats()
 {
-    auto stats               = cr::renderer::renderer_stats();
-    stats.rays_per_second    = _total_rays / _timer.time_since_start();
-    stats.samples_per_second = _current_sample / _timer.time_since_start();
-    stats.total_rays         = _total_rays;
+    auto stats = cr::renderer::renderer_stats();
+    for (auto i = 0; i < _tiles.size(); i++) _tile_counters[i].add_to(stats.counters);
+
+    stats.rays_per_second    = stats.counters.total_rays() / _timer.time_since_start();
+    stats.average_samples    = 0.0;
+    for (auto i = 0; i < _tiles.size(); i++)
+        stats.average_samples += static_cast<double>(_tile_progress[i].load());
+    stats.average_samples /= glm::max(_tiles.size(), size_t(1));
+    stats.samples_per_second = stats.average_samples / _timer.time_since_start();
+    stats.total_rays         = stats.counters.total_rays();
+    stats.retired_tiles      = 0;
+    for (auto i = 0; i < _tiles.size(); i++) stats.retired_tiles += _tile_retired[i] ? 1 : 0;
     stats.running_time       = _timer.time_since_start();
     return stats;
 }
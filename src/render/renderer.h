@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <random>
 #include <cmath>
+#include <cstring>
 #include <array>
 #include <iostream>
 #include <filesystem>
@@ -15,6 +16,10 @@
 #include <render/camera.h>
 #include <render/scene.h>
 #include <render/brdf.h>
+#include <render/sampler.h>
+#include <render/aov.h>
+#include <render/metrics.h>
+#include <render/checkpoint.h>
 #include <objects/thread_pool.h>
 #include <util/sampling.h>
 #include <render/timer.h>
@@ -45,32 +50,290 @@ namespace cr
 
         void set_target_spp(uint64_t target);
 
+        /*
+         * Limits a render stops at, whichever is reached first. A limit of 0 is off. The sample
+         * limit is the same one set_target_spp sets, the error is the mean relative error of the
+         * image as measured for adaptive sampling. A pass that would overrun the time limit,
+         * going by how long that tile's earlier passes took, isn't started.
+         */
+        struct render_budget
+        {
+            double   seconds = 0.0;
+            uint64_t samples = 0;
+            float    error   = 0.0f;
+        };
+        void set_budget(const render_budget &budget);
+
+        [[nodiscard]] render_budget budget() const noexcept;
+
+        // True once every tile is done or a budget limit has been reached
+        [[nodiscard]] bool finished() const noexcept;
+
+        // Tiles are the unit of work handed to the thread pool, {res_x, 1} gives a row per task
+        void set_tile_size(int x, int y);
+
+        // How many samples a tile takes in one go, keeping its pixels hot in that core's cache
+        void set_tile_samples(uint64_t samples);
+
+        /*
+         * Renders only sample indices [first, first + count) of each pixel, count replaces the
+         * sample target. Samplers are seeded by pixel, sample index and dimension alone, so
+         * renders of disjoint ranges sum to the accumulation of one render over all of them, see
+         * crender-merge. Adaptive sampling decides per render, so it breaks that.
+         */
+        void set_sample_range(uint64_t first, uint64_t count);
+
+        // Only renders pixels in [min, max), the rest stay empty. An empty region is everything
+        void set_region(const glm::ivec2 &min, const glm::ivec2 &max);
+
+        /*
+         * Tiles touching [min, max) are brought up to the given samples per pixel before any other
+         * tile gets a pass, then everything carries on to the target together. Takes effect
+         * without restarting the render, an empty region turns it off.
+         */
+        void set_region_of_interest(const glm::ivec2 &min, const glm::ivec2 &max, uint64_t samples);
+
+        enum class integrator
+        {
+            path,         // Whole path per pixel, camera rays traced as packets
+            wavefront,    // Every path in a tile advanced one bounce at a time as a stream
+        };
+        void set_integrator(integrator type);
+
+        void set_sampler(cr::sampler::type type);
+
+        /*
+         * Retires a tile once the relative error of its pixels' mean drops below the threshold,
+         * checked after every pass from min_samples on. A threshold of 0 samples every tile to
+         * the target.
+         */
+        void set_adaptive_sampling(float error_threshold, uint64_t min_samples);
+
+        /*
+         * Once a path has bounced min_depth times it's randomly terminated with a probability
+         * based on its throughput luminance. Survivors are weighted up, so the image converges
+         * to the same result while dim paths stop wasting rays.
+         */
+        void set_russian_roulette(bool enabled, int min_depth);
+
+        /*
+         * When the camera has moved, start() keeps the accumulation of every pixel whose first hit
+         * is still in view instead of clearing it. Each pixel's first hit is traced again from the
+         * new camera and projected into the old one, and the history there is kept if its depth
+         * and normal agree. At most max_history samples of it are kept so new samples take over
+         * quickly. Only the camera is compared, anything else changed in the same update leaves
+         * stale history behind.
+         */
+        void set_reprojection(bool enabled, uint32_t max_history);
+
+        /*
+         * Before the first full resolution pass after start, traces one path per 4x4 and then
+         * per 2x2 block of pixels and stretches it over the block until the pixels have samples
+         * of their own. Costs about a third of a sample per pixel, none of it is accumulated.
+         */
+        void set_progressive_preview(bool enabled);
+
+        // Times tracing, shading and accumulation separately, costs a few clock reads per bounce
+        void set_profiling(bool enabled);
+
         struct renderer_stats
         {
             uint64_t rays_per_second;
             uint64_t samples_per_second;
             uint64_t total_rays;
             double running_time;
+            double average_samples;
+            uint64_t retired_tiles;
+
+            cr::metrics::counters counters;    // Summed over every tile
         };
 
         [[nodiscard]] renderer_stats current_stats();
 
+        struct render_eta
+        {
+            enum class limit
+            {
+                none,
+                time,
+                samples,
+                error,
+            };
+
+            double seconds;    // Until the render stops, infinite while it can't be told yet
+            limit  limiting;   // The limit expected to stop the render first
+            float  error;      // Mean relative error of the image so far
+
+            // Lower case name of a limit, for logs and the UI
+            [[nodiscard]] static const char *name(limit value) noexcept;
+        };
+
+        /*
+         * Predicts when the budget runs out from the measured time per tile pass and, for the
+         * error limit, the rate the error has been falling at so far. The render records that
+         * rate itself as it goes, asking doesn't change the answer.
+         */
+        [[nodiscard]] render_eta current_eta() const;
+
+        // Samples every pixel has reached, tiles progress independently so some may be ahead
         [[nodiscard]] uint64_t current_sample_count() const noexcept;
 
         [[nodiscard]] glm::ivec2 current_resolution() const noexcept;
 
-        [[nodiscard]] cr::image *current_progress() noexcept;
+        /*
+         * Allocates the output, fills it in from a ray through each pixel centre and has every
+         * tile keep it up to date from its next pass on, without restarting the render. Outputs
+         * nobody asks for cost neither memory nor bandwidth.
+         */
+        void set_aov_enabled(cr::aov output, bool enabled);
 
-        [[nodiscard]] cr::image *current_normals() noexcept;
+        [[nodiscard]] bool aov_enabled(cr::aov output) const noexcept;
 
-        [[nodiscard]] cr::image *current_albedos() noexcept;
+        // Immutable copy of the render, safe to hold on to while rendering carries on. AOVs that
+        // aren't enabled are left as empty images
+        struct frame
+        {
+            cr::image colour;    // Divided, clamped and gamma corrected
+            cr::image albedo;
+            cr::image normals;
+            cr::image depth;
+            cr::image error;    // Relative error of each pixel's mean, see set_adaptive_sampling
+
+            uint64_t samples;      // Samples every pixel in the frame has reached
+            double   timestamp;    // Seconds since the render started
+        };
+
+        /*
+         * Copies the render out without pausing it, resolving the accumulated samples on the way.
+         * A tile that's mid pass keeps what it had in the previous snapshot, so a frame never
+         * mixes two passes of one tile. Workers never wait on this, and while nothing has changed
+         * the same frame is handed out again.
+         */
+        [[nodiscard]] std::shared_ptr<const frame> snapshot();
 
-        [[nodiscard]] cr::image *current_depths() noexcept;
+        // Mean of count RGB sums with their sample count in the fourth channel, clamped and
+        // gamma corrected the way frame::colour is
+        static void resolve(const float *sums, size_t count, float *rgba) noexcept;
+
+        /*
+         * Saves the accumulated samples, every tile's progress, the sampler and tile layout and
+         * how long the render has run, tagged with a fingerprint of the scene, camera and the
+         * settings the image depends on. Tiles are copied between passes, rendering carries on.
+         */
+        bool save_checkpoint(const std::string &path, bool compress);
+
+        /*
+         * Carries on from a checkpoint taken of this scene and camera at this resolution, anything
+         * else is refused. The sampler, tile layout and running time are restored with it, so a
+         * time budget counts the time before the checkpoint too.
+         */
+        bool load_checkpoint(const std::string &path);
 
     private:
-        [[nodiscard]] std::vector<std::function<void()>> _get_tasks();
+        struct tile
+        {
+            glm::ivec2 min;
+            glm::ivec2 max;
+        };
 
-        void _sample_pixel(uint64_t x, uint64_t , size_t &fired_rays);
+        // Reallocates the tiles' state, callers hold _snapshot_mutex since snapshots read it
+        void _build_tiles();
+
+        // The region clipped to the image, the whole image if none was set
+        [[nodiscard]] std::pair<glm::ivec2, glm::ivec2> _clipped_region() const noexcept;
+
+        // Lets the management thread carry on after pause without resetting anything
+        void _resume();
+
+        // Moves the accumulation over to the current camera in place, false if there's nothing to
+        // reproject
+        [[nodiscard]] bool _reproject();
+
+        // Renders the next few samples of a tile, returns true while it needs more than target
+        [[nodiscard]] bool _render_tile(uint32_t index, uint64_t target);
+
+        // Tiles touching the region of interest
+        [[nodiscard]] std::vector<uint32_t> _priority_tiles();
+
+        // One preview path per block of block_size by block_size pixels over the tile
+        void _preview_tile(uint32_t index, int block_size);
+
+        [[nodiscard]] bool _needs_samples() const noexcept;
+
+        // Whether the tile's next few samples would still finish inside the time budget
+        [[nodiscard]] bool _fits_time_budget(uint32_t index, uint64_t samples) const noexcept;
+
+        // Mean of the tiles' last measured error, infinite until every tile has one
+        [[nodiscard]] float _image_error() const noexcept;
+
+        // True for at most one pass per convergence interval, that pass checks the error budget
+        [[nodiscard]] bool _claim_convergence_check() noexcept;
+
+        // Adds to the convergence history the ETA's error rate comes from
+        void _record_convergence();
+
+        // Which limit ended a finished render
+        [[nodiscard]] render_eta::limit _stopped_by() const noexcept;
+
+        // Writes an AOV that was just enabled over the whole image, passes only keep it current
+        void _fill_aov(cr::aov output);
+
+        // Updates the error AOV over the tile and returns the average relative error
+        [[nodiscard]] float _tile_error(const tile &tile);
+
+        void _trace_packets(
+          const tile &tile,
+          uint64_t    sample,
+          bool                   first_of_pass,
+          cr::metrics::counters &counters);
+
+        void _trace_wavefront(
+          const tile &tile,
+          uint64_t    first_sample,
+          uint64_t               samples,
+          cr::metrics::counters &counters);
+
+        // Radiance of one path and what its first hit saw
+        struct path_sample
+        {
+            glm::vec3 radiance;
+            glm::vec3 albedo;
+            glm::vec3 normal;
+            float     depth;
+        };
+
+        // Traces a full path, the first intersection comes from the camera ray packet
+        [[nodiscard]] path_sample _trace_path(
+          cr::sample_stream                   stream,
+          cr::ray                             ray,
+          const cr::ray::intersection_record &camera_hit,
+          cr::metrics::counters &             counters);
+
+        void _accumulate(
+          uint64_t         x,
+          uint64_t         y,
+          bool             first_of_pass,
+          const glm::vec3 &radiance,
+          const glm::vec3 &albedo,
+          const glm::vec3 &normal,
+          float            depth);
+
+        // Writes the AOVs and reprojection history of a pixel, x and y are already flipped
+        void _store_first_hit(
+          uint64_t         x,
+          uint64_t         y,
+          const glm::vec3 &albedo,
+          const glm::vec3 &normal,
+          float            depth);
+
+        // Copies a tile's live buffers into the frame, false if a worker wrote to it since the
+        // tile was at the given version
+        [[nodiscard]] bool _capture_tile(uint32_t index, uint64_t version, frame &out);
+
+        // Same as _capture_tile for the raw sums and the tile's state, false if mid pass
+        [[nodiscard]] bool _checkpoint_tile(uint32_t index, cr::checkpoint::state &out);
+
+        [[nodiscard]] uint64_t _fingerprint();
 
         cr::timer _timer;
 
@@ -78,23 +341,56 @@ namespace cr
         uint64_t                          _res_x;
         uint64_t                          _res_y;
         float                             _aspect_correction = 1;
-        uint64_t                          _spp_target        = 0;
+        glm::ivec2                        _tile_size         = glm::ivec2(32, 32);
+        glm::ivec2                        _region_min        = glm::ivec2(0, 0);
+        glm::ivec2                        _region_max        = glm::ivec2(0, 0);
+        uint64_t                          _first_sample      = 0;
+        uint64_t                          _tile_samples      = 1;
+        integrator                        _integrator        = integrator::path;
+        float                             _error_threshold   = 0.0f;
+        uint64_t                          _adaptive_min_spp  = 16;
+        bool                              _roulette_enabled  = true;
+        int                               _roulette_depth    = 3;
+        bool                              _profiling         = false;
+        cr::sampler::type                 _sampler_type      = cr::sampler::type::sobol;
+        std::unique_ptr<cr::sampler>      _sampler;
         std::unique_ptr<cr::thread_pool> *_thread_pool;
 
         std::unique_ptr<cr::scene> *_scene;
-        std::vector<float>          _raw_buffer;
+        std::vector<float>          _raw_buffer;       // Radiance sum and sample count per pixel
+        std::vector<float>          _moment_buffer;    // Sum of squared luminance per pixel
+        std::vector<tile>           _tiles;
 
-        cr::image _buffer;
+        std::unique_ptr<std::atomic<uint64_t>[]>      _tile_progress;
+        std::unique_ptr<std::atomic<bool>[]>          _tile_retired;
+        std::unique_ptr<std::atomic<uint64_t>[]>      _tile_version;    // Odd during a pass
+        std::unique_ptr<cr::metrics::tile_counters[]> _tile_counters;
+        std::unique_ptr<std::atomic<float>[]>         _tile_error_estimate;
 
-        cr::image _normals;
-        cr::image _depth;
-        cr::image _albedo;
+        // Indexed by cr::aov, unallocated while nothing has asked for that output
+        std::array<cr::aov_buffer, cr::aov_count> _aovs;
+
+        // First hit distance and normal of every pixel and the camera they were seen from, only
+        // kept while reprojecting
+        cr::aov_buffer            _history_depth;
+        cr::aov_buffer            _history_normals;
+        std::optional<cr::camera> _history_camera;
+        float                     _max_history = 0.0f;
+
+        // Preview colour with a count of one, zero until a preview level reached the pixel. Only
+        // allocated while the progressive preview is on
+        std::vector<float> _preview_buffer;
+        std::atomic<bool>  _preview_pending = false;
 
         std::atomic<bool>     _run_management = true;
         std::atomic<bool>     _pause          = false;
+        std::atomic<bool>     _idle           = false;
         std::atomic<uint64_t> _max_bounces;
-        std::atomic<uint64_t> _total_rays;
-        std::atomic<uint64_t> _current_sample = 0;
+        std::atomic<uint64_t> _spp_target     = 0;
+        std::atomic<double>   _time_budget    = 0.0;
+        std::atomic<float>    _error_budget   = 0.0f;
+        std::atomic<bool>     _error_reached  = false;
+        std::atomic<bool>     _reschedule     = false;    // Ends the running passes early
         std::thread           _management_thread;
 
         std::mutex              _start_mutex;
@@ -102,5 +398,31 @@ namespace cr
 
         std::mutex              _pause_mutex;
         std::condition_variable _pause_cond_var;
+
+        std::mutex _interest_mutex;
+        glm::ivec2 _interest_min     = glm::ivec2(0, 0);
+        glm::ivec2 _interest_max     = glm::ivec2(0, 0);
+        uint64_t   _interest_samples = 0;
+
+        struct snapshot_buffer
+        {
+            std::shared_ptr<frame> snapshot;
+            std::vector<uint64_t>  versions;    // Tile versions the frame holds
+            std::vector<uint64_t>  samples;
+        };
+
+        // Taken by readers and by whatever reallocates what they read, workers never wait on it.
+        // The front was handed out last, the back is updated while nobody holds it and becomes
+        // the next front
+        std::mutex                      _snapshot_mutex;
+        std::array<snapshot_buffer, 2>  _snapshot_buffers;
+        size_t                          _snapshot_front = 0;
+        std::array<bool, cr::aov_count> _snapshot_aovs {};
+        std::vector<uint8_t>            _capture_scratch;
+
+        // Average samples per pixel against image error, recorded by _record_convergence
+        mutable std::mutex                     _eta_mutex;
+        std::vector<std::pair<double, double>> _convergence;
+        std::atomic<double>                    _convergence_checked = 0.0;    // Timer seconds
     };
 }    // namespace cr
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "sampler.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+    namespace hash = cr::sampling::hash;
+
+    [[nodiscard]] uint32_t reverse_bits(uint32_t x) noexcept
+    {
+        x = (x << 16u) | (x >> 16u);
+        x = ((x & 0x00ff00ffu) << 8u) | ((x & 0xff00ff00u) >> 8u);
+        x = ((x & 0x0f0f0f0fu) << 4u) | ((x & 0xf0f0f0f0u) >> 4u);
+        x = ((x & 0x33333333u) << 2u) | ((x & 0xccccccccu) >> 2u);
+        x = ((x & 0x55555555u) << 1u) | ((x & 0xaaaaaaaau) >> 1u);
+        return x;
+    }
+
+    // Hash based Owen scrambling, "Practical Hash-based Owen Scrambling" (Burley 2020)
+    [[nodiscard]] uint32_t owen_scramble(uint32_t x, uint32_t seed) noexcept
+    {
+        x = reverse_bits(x);
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return reverse_bits(x);
+    }
+
+    // The first two Sobol dimensions, together they're a (0, 2) sequence
+    [[nodiscard]] uint32_t sobol_0(uint32_t index) noexcept
+    {
+        return reverse_bits(index);
+    }
+
+    [[nodiscard]] uint32_t sobol_1(uint32_t index) noexcept
+    {
+        auto result = 0u;
+        for (auto v = 1u << 31u; index != 0; index >>= 1u, v ^= v >> 1u)
+            if (index & 1u) result ^= v;
+        return result;
+    }
+
+    // Shuffles the sample order and scrambles both dimensions, all from one seed
+    [[nodiscard]] glm::vec2 scrambled_sobol(uint64_t sample, uint32_t seed) noexcept
+    {
+        const auto index = owen_scramble(static_cast<uint32_t>(sample), seed);
+
+        return glm::vec2(
+          hash::to_float(owen_scramble(sobol_0(index), hash::pcg(hash::combine(seed, 1)))),
+          hash::to_float(owen_scramble(sobol_1(index), hash::pcg(hash::combine(seed, 2)))));
+    }
+
+    constexpr auto mask_size = 64u;
+
+    /*
+     * Blue noise dither mask built with the void filling phase of void and cluster (Ulichney
+     * 1993): every texel is ranked by the order it gets placed in, always into the largest void
+     * left between the ones placed so far.
+     */
+    [[nodiscard]] std::vector<float> build_blue_noise_mask()
+    {
+        constexpr auto texels = mask_size * mask_size;
+        constexpr auto sigma  = 1.5f;
+
+        auto kernel = std::vector<float>(texels);
+        for (auto y = 0u; y < mask_size; y++)
+            for (auto x = 0u; x < mask_size; x++)
+            {
+                const auto dx = static_cast<float>(std::min(x, mask_size - x));
+                const auto dy = static_cast<float>(std::min(y, mask_size - y));
+
+                kernel[x + y * mask_size] =
+                  std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+            }
+
+        auto mask   = std::vector<float>(texels);
+        auto energy = std::vector<float>(texels, 0.0f);
+        auto placed = std::vector<bool>(texels, false);
+
+        auto next = hash::pcg(0) % texels;
+        for (auto rank = 0u; rank < texels; rank++)
+        {
+            placed[next] = true;
+            mask[next]   = (static_cast<float>(rank) + 0.5f) / static_cast<float>(texels);
+
+            const auto next_x = next % mask_size;
+            const auto next_y = next / mask_size;
+
+            auto lowest     = std::numeric_limits<float>::infinity();
+            auto void_texel = 0u;
+            for (auto y = 0u; y < mask_size; y++)
+                for (auto x = 0u; x < mask_size; x++)
+                {
+                    const auto texel  = x + y * mask_size;
+                    const auto offset = (x + mask_size - next_x) % mask_size +
+                      ((y + mask_size - next_y) % mask_size) * mask_size;
+
+                    energy[texel] += kernel[offset];
+                    if (!placed[texel] && energy[texel] < lowest)
+                    {
+                        lowest     = energy[texel];
+                        void_texel = texel;
+                    }
+                }
+
+            next = void_texel;
+        }
+
+        return mask;
+    }
+
+    class random_sampler : public cr::sampler
+    {
+    public:
+        [[nodiscard]] float
+          get(const glm::uvec2 &pixel, uint64_t sample, uint32_t dimension) const noexcept override
+        {
+            return hash::to_float(hash::pixel(pixel, sample, dimension));
+        }
+    };
+
+    class sobol_sampler : public cr::sampler
+    {
+    public:
+        [[nodiscard]] float
+          get(const glm::uvec2 &pixel, uint64_t sample, uint32_t dimension) const noexcept override
+        {
+            return get_2d(pixel, sample, dimension).x;
+        }
+
+        [[nodiscard]] glm::vec2
+          get_2d(const glm::uvec2 &pixel, uint64_t sample, uint32_t dimension) const noexcept override
+        {
+            // A seed that changed per sample would break the stratification between samples
+            return ::scrambled_sobol(sample, hash::pixel(pixel, 0, dimension));
+        }
+    };
+
+    class blue_noise_sampler : public cr::sampler
+    {
+    public:
+        blue_noise_sampler() : _mask(::build_blue_noise_mask()) { }
+
+        [[nodiscard]] float
+          get(const glm::uvec2 &pixel, uint64_t sample, uint32_t dimension) const noexcept override
+        {
+            return get_2d(pixel, sample, dimension).x;
+        }
+
+        [[nodiscard]] glm::vec2
+          get_2d(const glm::uvec2 &pixel, uint64_t sample, uint32_t dimension) const noexcept override
+        {
+            // Every pixel walks the same sequence, only rotated by its mask value, so the error
+            // between neighbouring pixels ends up as high frequency noise
+            const auto value  = ::scrambled_sobol(sample, hash::pcg(dimension));
+            const auto offset = glm::vec2(_offset(pixel, dimension), _offset(pixel, dimension + 1));
+
+            // fract can round up to exactly 1
+            return glm::min(glm::fract(value + offset), glm::vec2(0.99999994f));
+        }
+
+    private:
+        // Each dimension reads the mask at its own toroidal shift so dimensions stay decorrelated
+        [[nodiscard]] float _offset(const glm::uvec2 &pixel, uint32_t dimension) const noexcept
+        {
+            const auto shift = hash::pcg(hash::combine(0x2545f491u, dimension));
+            const auto x     = (pixel.x + (shift & (mask_size - 1))) % mask_size;
+            const auto y     = (pixel.y + ((shift >> 8u) & (mask_size - 1))) % mask_size;
+
+            return _mask[x + y * mask_size];
+        }
+
+        std::vector<float> _mask;
+    };
+}    // namespace
+
+std::unique_ptr<cr::sampler> cr::sampler::create(type sampler_type)
+{
+    switch (sampler_type)
+    {
+    case type::random: return std::make_unique<::random_sampler>();
+    case type::sobol: return std::make_unique<::sobol_sampler>();
+    case type::blue_noise: return std::make_unique<::blue_noise_sampler>();
+    }
+
+    return std::make_unique<::random_sampler>();
+}
+
+glm::vec2
+  cr::sampler::get_2d(const glm::uvec2 &pixel, uint64_t sample, uint32_t dimension) const noexcept
+{
+    return glm::vec2(get(pixel, sample, dimension), get(pixel, sample, dimension + 1));
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+namespace cr
+{
+    /*
+     * Source of the random numbers a path consumes. Every number is addressed by the pixel,
+     * the sample index within that pixel and the dimension within that sample, so a sequence
+     * can stratify across the samples of one pixel while neighbouring pixels stay decorrelated.
+     * Implementations are stateless and shared between every worker.
+     */
+    class sampler
+    {
+    public:
+        enum class type
+        {
+            random,        // PCG hash of (pixel, sample, dimension), white noise
+            sobol,         // Owen scrambled Sobol (0, 2) sequence, shuffled per pixel
+            blue_noise,    // Sobol shared by every pixel, dithered per pixel by a blue noise mask
+        };
+
+        virtual ~sampler() = default;
+
+        [[nodiscard]] static std::unique_ptr<cr::sampler> create(type sampler_type);
+
+        // Returns a number in [0, 1)
+        [[nodiscard]] virtual float
+          get(const glm::uvec2 &pixel, uint64_t sample, uint32_t dimension) const noexcept = 0;
+
+        // Consecutive pairs are used together, e.g. for a direction, so they get a 2D sequence
+        [[nodiscard]] virtual glm::vec2
+          get_2d(const glm::uvec2 &pixel, uint64_t sample, uint32_t dimension) const noexcept;
+    };
+
+    // Walks the dimensions of one sample of one pixel
+    class sample_stream
+    {
+    public:
+        sample_stream(
+          const cr::sampler &sampler,
+          const glm::uvec2 & pixel,
+          uint64_t           sample,
+          uint32_t           dimension = 0) noexcept
+            : _sampler(&sampler), _pixel(pixel), _sample(sample), _dimension(dimension)
+        {
+        }
+
+        [[nodiscard]] float next_1d() noexcept
+        {
+            return _sampler->get(_pixel, _sample, _dimension++);
+        }
+
+        [[nodiscard]] glm::vec2 next_2d() noexcept
+        {
+            const auto value = _sampler->get_2d(_pixel, _sample, _dimension);
+            _dimension += 2;
+            return value;
+        }
+
+        // Paths consume a varying amount of numbers per bounce, this keeps bounces aligned
+        void skip_to(uint32_t dimension) noexcept
+        {
+            _dimension = dimension;
+        }
+
+    private:
+        const cr::sampler *_sampler;
+        glm::uvec2         _pixel;
+        uint64_t           _sample;
+        uint32_t           _dimension;
+    };
+
+    namespace sampling::hash
+    {
+        // PCG output permutation over a 32 bit counter
+        [[nodiscard]] inline uint32_t pcg(uint32_t value) noexcept
+        {
+            const auto state = value * 747796405u + 2891336453u;
+            const auto word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+            return (word >> 22u) ^ word;
+        }
+
+        [[nodiscard]] inline uint32_t combine(uint32_t seed, uint32_t value) noexcept
+        {
+            return seed ^ (value + 0x9e3779b9u + (seed << 6u) + (seed >> 2u));
+        }
+
+        [[nodiscard]] inline uint32_t
+          pixel(const glm::uvec2 &pixel, uint64_t sample, uint32_t dimension) noexcept
+        {
+            auto seed = pcg(pixel.x);
+            seed      = pcg(combine(seed, pixel.y));
+            seed      = pcg(combine(seed, static_cast<uint32_t>(sample)));
+            seed      = pcg(combine(seed, static_cast<uint32_t>(sample >> 32u)));
+            return pcg(combine(seed, dimension));
+        }
+
+        // Maps the top 24 bits to [0, 1)
+        [[nodiscard]] inline float to_float(uint32_t value) noexcept
+        {
+            return static_cast<float>(value >> 8u) * (1.0f / 16777216.0f);
+        }
+    }    // namespace sampling::hash
+}    // namespace cr
@@ -1,13 +1,10 @@
 #include "scene.h"
 
+#include <render/checkpoint.h>
+
 namespace
 {
-    [[nodiscard]] float randf() noexcept
-    {
-        thread_local std::mt19937                          gen;
-        thread_local std::uniform_real_distribution<float> dist(0.f, 1.f);
-        return dist(gen);
-    }
+    thread_local auto alpha_skip_count = uint64_t(0);
 
     [[nodiscard]] float intersect_unit_rect(const cr::ray &ray)
     {
@@ -26,15 +23,316 @@ namespace
         }
         return std::numeric_limits<float>::infinity();
     }
+
+    [[nodiscard]] RTCRay make_ray(const cr::ray &ray, float tmax)
+    {
+        auto out = RTCRay();
+
+        out.org_x = ray.origin.x;
+        out.org_y = ray.origin.y;
+        out.org_z = ray.origin.z;
+
+        out.dir_x = ray.direction.x;
+        out.dir_y = ray.direction.y;
+        out.dir_z = ray.direction.z;
+
+        out.tnear = 0.00001f;
+        out.tfar  = tmax;
+        out.time  = 0.0f;
+        out.mask  = -1;
+        out.flags = 0;
+
+        return out;
+    }
+
+    [[nodiscard]] RTCRayHit make_ray_hit(const cr::ray &ray)
+    {
+        auto ray_hit = RTCRayHit();
+
+        ray_hit.ray           = make_ray(ray, std::numeric_limits<float>::infinity());
+        ray_hit.hit.geomID    = RTC_INVALID_GEOMETRY_ID;
+        ray_hit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+
+        return ray_hit;
+    }
+
+    void log_device_error(void *, RTCError code, const char *message)
+    {
+        cr::logger::error("Embree error [{}]: {}", static_cast<int>(code), message);
+    }
+
+    [[nodiscard]] RTCDevice create_device(const std::string &config)
+    {
+        auto device = rtcNewDevice(config.c_str());
+        if (device == nullptr)
+        {
+            cr::logger::error(
+              "Failed to create Embree device with config [{}], error [{}]",
+              config,
+              static_cast<int>(rtcGetDeviceError(nullptr)));
+            return nullptr;
+        }
+
+        rtcSetDeviceErrorFunction(device, log_device_error, nullptr);
+        return device;
+    }
 }    // namespace
 
+std::string cr::scene::device_settings::to_config() const
+{
+    auto config = fmt::format(
+      "threads={},set_affinity={},hugepages={}",
+      threads,
+      set_affinity ? 1 : 0,
+      hugepages ? 1 : 0);
+
+    if (!isa.empty()) config += fmt::format(",isa={}", isa);
+
+    return config;
+}
+
+cr::scene::scene(const std::string &device_config) : _device_config(device_config)
+{
+    _device = ::create_device(device_config);
+    if (_device == nullptr)
+        cr::exit(fmt::format("Invalid Embree device config [{}]", device_config));
+
+    _build_top_level();
+}
+
+cr::scene::~scene()
+{
+    rtcReleaseScene(_top_level);
+    rtcReleaseDevice(_device);
+}
+
 void cr::scene::add_model(const cr::asset_loader::model_data &model)
 {
-    _entities.register_model(model);
+    const auto entity = _entities.register_model(model, _device);
+    _attach_alpha_filter(entity);
+    _build_top_level();
+}
+
+void cr::scene::set_instances(uint32_t entity, const std::vector<glm::mat4> &transforms)
+{
+    _entities.entities.get<cr::entity::instances>(entity).transforms = transforms;
+    _build_top_level();
+}
+
+bool cr::scene::set_device_config(const std::string &config)
+{
+    auto device = ::create_device(config);
+    if (device == nullptr) return false;
+
+    rtcReleaseScene(_top_level);
+    _top_level = nullptr;
+
+    const auto &view = _entities.entities.view<cr::entity::geometry, cr::entity::embree_ctx>();
+
+    for (const auto &entity : view)
+    {
+        const auto &geometry   = _entities.entities.get<cr::entity::geometry>(entity);
+        auto &      embree_ctx = _entities.entities.get<cr::entity::embree_ctx>(entity);
+
+        rtcReleaseGeometry(embree_ctx.geometry);
+        rtcReleaseScene(embree_ctx.scene);
+
+        embree_ctx = cr::model::instance_geometry(
+          device,
+          *geometry.vert_coords,
+          *geometry.vert_indices,
+          *geometry.tex_coords);
+        _attach_alpha_filter(entity);
+    }
+
+    rtcReleaseDevice(_device);
+    _device        = device;
+    _device_config = config;
+
+    _build_top_level();
+    cr::logger::info("Created Embree device with config [{}]", config);
+    return true;
+}
+
+const std::string &cr::scene::device_config() const noexcept
+{
+    return _device_config;
+}
+
+void cr::scene::_build_top_level()
+{
+    // Rebuilt from scratch, it only holds one leaf per instance so this is cheap next to the
+    // model BVHs underneath it
+    if (_top_level != nullptr) rtcReleaseScene(_top_level);
+    _top_level = rtcNewScene(_device);
+    _instances.clear();
+
+    const auto &view =
+      _entities.entities
+        .view<cr::entity::instances, cr::entity::embree_ctx, cr::entity::model_materials>();
+
+    for (const auto &entity : view)
+    {
+        const auto &instances  = _entities.entities.get<cr::entity::instances>(entity);
+        const auto &embree_ctx = _entities.entities.get<cr::entity::embree_ctx>(entity);
+
+        for (const auto &transform : instances.transforms)
+        {
+            auto instance = rtcNewGeometry(_device, RTC_GEOMETRY_TYPE_INSTANCE);
+            rtcSetGeometryInstancedScene(instance, embree_ctx.scene);
+            rtcSetGeometryTimeStepCount(instance, 1);
+            rtcSetGeometryTransform(
+              instance,
+              0,
+              RTC_FORMAT_FLOAT4X4_COLUMN_MAJOR,
+              glm::value_ptr(transform));
+            rtcCommitGeometry(instance);
+
+            const auto id = rtcAttachGeometry(_top_level, instance);
+            rtcReleaseGeometry(instance);
+
+            if (_instances.size() <= id) _instances.resize(id + 1);
+            _instances[id] = instance_info {
+                entity,
+                glm::transpose(glm::inverse(glm::mat3(transform))),
+            };
+        }
+    }
+
+    rtcCommitScene(_top_level);
+}
+
+void cr::scene::_attach_alpha_filter(uint32_t entity)
+{
+    const auto &materials  = _entities.entities.get<cr::entity::model_materials>(entity);
+    const auto &embree_ctx = _entities.entities.get<cr::entity::embree_ctx>(entity);
+
+    if (!_has_alpha_materials(materials))
+    {
+        _alpha_filters.erase(entity);
+        return;
+    }
+
+    auto &filter = _alpha_filters[entity];
+    filter =
+      std::make_unique<alpha_filter>(alpha_filter { &_entities, entity, embree_ctx.geometry });
+
+    rtcSetGeometryUserData(embree_ctx.geometry, filter.get());
+    rtcSetGeometryIntersectFilterFunction(embree_ctx.geometry, _filter_alpha);
+    rtcSetGeometryOccludedFilterFunction(embree_ctx.geometry, _filter_alpha);
+    rtcCommitGeometry(embree_ctx.geometry);
+    rtcCommitScene(embree_ctx.scene);
+}
+
+void cr::scene::_filter_alpha(const RTCFilterFunctionNArguments *args)
+{
+    const auto &filter    = *static_cast<const alpha_filter *>(args->geometryUserPtr);
+    const auto &materials = filter.registry->entities.get<cr::entity::model_materials>(filter.entity);
+
+    for (auto i = 0u; i < args->N; i++)
+    {
+        if (args->valid[i] != -1) continue;
+
+        const auto  primitive = RTCHitN_primID(args->hit, args->N, i);
+        const auto &material  = materials.materials[materials.indices[primitive]];
+
+        auto alpha = material.info.colour.w;
+        if (material.info.tex.has_value())
+        {
+            auto uv = glm::vec2();
+            rtcInterpolate0(
+              filter.geometry,
+              primitive,
+              RTCHitN_u(args->hit, args->N, i),
+              RTCHitN_v(args->hit, args->N, i),
+              RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE,
+              0,
+              &uv.x,
+              2);
+
+            alpha = filter.registry->entities.get<cr::image>(material.info.tex.value())
+                      .get_uv(uv.x, uv.y)
+                      .w;
+        }
+
+        if (alpha == 0.0f)
+        {
+            args->valid[i] = 0;
+            ::alpha_skip_count++;
+        }
+    }
+}
+
+uint64_t cr::scene::alpha_skips() noexcept
+{
+    return ::alpha_skip_count;
+}
+
+bool cr::scene::_has_alpha_materials(const cr::entity::model_materials &materials)
+{
+    for (const auto &material : materials.materials)
+    {
+        if (!material.info.tex.has_value())
+        {
+            if (material.info.colour.w == 0.0f) return true;
+            continue;
+        }
+
+        const auto texture = material.info.tex.value();
+        if (const auto it = _texture_has_alpha.find(texture); it != _texture_has_alpha.end())
+        {
+            if (it->second) return true;
+            continue;
+        }
+
+        const auto &image     = _entities.entities.get<cr::image>(texture);
+        const auto  texels    = image.width() * image.height();
+        auto        has_alpha = false;
+        for (auto i = uint64_t(0); i < texels && !has_alpha; i++)
+            has_alpha = image.data()[i * 4 + 3] == 0.0f;
+
+        _texture_has_alpha[texture] = has_alpha;
+        if (has_alpha) return true;
+    }
+
+    return false;
+}
+
+cr::ray::intersection_record cr::scene::_make_record(
+  const cr::ray &  ray,
+  float            distance,
+  const glm::vec3 &object_normal,
+  uint32_t         primitive,
+  const glm::vec2 &barycentric,
+  uint32_t         instance) const
+{
+    const auto &info       = _instances[instance];
+    const auto &embree_ctx = _entities.entities.get<cr::entity::embree_ctx>(info.entity);
+    const auto &materials  = _entities.entities.get<cr::entity::model_materials>(info.entity);
+
+    auto record               = cr::ray::intersection_record();
+    record.prim_id            = primitive;
+    record.distance           = distance;
+    record.intersection_point = ray.at(distance);
+    record.normal             = glm::normalize(info.normal_matrix * object_normal);
+    record.material           = &materials.materials[materials.indices[primitive]];
+
+    rtcInterpolate0(
+      embree_ctx.geometry,
+      primitive,
+      barycentric.x,
+      barycentric.y,
+      RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE,
+      0,
+      &record.uv.x,
+      2);
+
+    return record;
 }
 
 void cr::scene::set_skybox(cr::image &&skybox)
 {
+#ifndef CRENDER_HEADLESS
     if (!_skybox.has_value())
     {
         _skybox_texture = 0;
@@ -56,12 +354,19 @@ void cr::scene::set_skybox(cr::image &&skybox)
       GL_RGBA,
       GL_FLOAT,
       skybox.data());
-    _skybox = skybox;
+#endif
+    _skybox              = skybox;
+    _skybox_distribution = cr::environment_map(*_skybox, _skybox_rotation.y);
 }
 
 void cr::scene::set_skybox_rotation(const glm::vec2 &rotation)
 {
+    // Turning the skybox around leaves every texel at its latitude, tilting it doesn't
+    const auto tilted = rotation.y != _skybox_rotation.y;
+
     _skybox_rotation = rotation;
+    if (tilted && _skybox.has_value())
+        _skybox_distribution = cr::environment_map(*_skybox, _skybox_rotation.y);
 }
 
 glm::vec3 cr::scene::sample_skybox(float x, float y) const noexcept
@@ -76,25 +381,166 @@ glm::vec3 cr::scene::sample_skybox(float x, float y) const noexcept
     }
 }
 
+cr::environment_map::direction_sample
+  cr::scene::sample_skybox_direction(const glm::vec2 &uv) const noexcept
+{
+    return _skybox_distribution.sample(uv, _skybox_rotation);
+}
+
+float cr::scene::skybox_pdf(const glm::vec3 &direction) const noexcept
+{
+    return _skybox_distribution.pdf(direction, _skybox_rotation);
+}
+
 cr::ray::intersection_record cr::scene::cast_ray(const cr::ray ray)
 {
-    auto intersection = cr::ray::intersection_record();
+    auto ctx = RTCIntersectContext();
+    rtcInitIntersectContext(&ctx);
+    auto ray_hit = ::make_ray_hit(ray);
 
-    const auto &view =
-      _entities.entities
-        .view<cr::entity::instances, cr::entity::embree_ctx, cr::entity::model_materials>();
+    rtcIntersect1(_top_level, &ctx, &ray_hit);
 
-    for (const auto &entity : view)
+    if (ray_hit.hit.geomID == RTC_INVALID_GEOMETRY_ID) return cr::ray::intersection_record();
+
+    return _make_record(
+      ray,
+      ray_hit.ray.tfar,
+      glm::vec3(ray_hit.hit.Ng_x, ray_hit.hit.Ng_y, ray_hit.hit.Ng_z),
+      ray_hit.hit.primID,
+      glm::vec2(ray_hit.hit.u, ray_hit.hit.v),
+      ray_hit.hit.instID[0]);
+}
+
+void cr::scene::cast_ray_packet(
+  const cr::ray_packet &                                          packet,
+  std::array<cr::ray::intersection_record, cr::ray_packet::size> &records)
+{
+    static_assert(cr::ray_packet::size == 8, "Packets are traced with rtcIntersect8");
+
+    auto ctx = RTCIntersectContext();
+    rtcInitIntersectContext(&ctx);
+    ctx.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
+
+    alignas(32) auto valid = std::array<int, cr::ray_packet::size>();
+    auto ray_hit           = RTCRayHit8();
+
+    for (auto i = 0; i < cr::ray_packet::size; i++)
     {
-        const auto &instances  = _entities.entities.get<cr::entity::instances>(entity);
-        const auto &embree_ctx = _entities.entities.get<cr::entity::embree_ctx>(entity);
-        const auto &materials  = _entities.entities.get<cr::entity::model_materials>(entity);
+        valid[i] = i < packet.count ? -1 : 0;
+
+        ray_hit.ray.org_x[i] = packet.origin_x[i];
+        ray_hit.ray.org_y[i] = packet.origin_y[i];
+        ray_hit.ray.org_z[i] = packet.origin_z[i];
 
-        const auto current = cr::model::intersect(ray, instances, embree_ctx, materials);
-        if (current.distance < intersection.distance) intersection = current;
+        ray_hit.ray.dir_x[i] = packet.direction_x[i];
+        ray_hit.ray.dir_y[i] = packet.direction_y[i];
+        ray_hit.ray.dir_z[i] = packet.direction_z[i];
+
+        ray_hit.ray.tnear[i]     = 0.00001f;
+        ray_hit.ray.tfar[i]      = std::numeric_limits<float>::infinity();
+        ray_hit.ray.time[i]      = 0.0f;
+        ray_hit.ray.mask[i]      = -1;
+        ray_hit.ray.flags[i]     = 0;
+        ray_hit.hit.geomID[i]    = RTC_INVALID_GEOMETRY_ID;
+        ray_hit.hit.instID[0][i] = RTC_INVALID_GEOMETRY_ID;
     }
 
-    return intersection;
+    rtcIntersect8(valid.data(), _top_level, &ctx, &ray_hit);
+
+    for (auto i = 0; i < packet.count; i++)
+    {
+        if (ray_hit.hit.geomID[i] == RTC_INVALID_GEOMETRY_ID)
+        {
+            records[i] = cr::ray::intersection_record();
+            continue;
+        }
+
+        records[i] = _make_record(
+          packet.get(i),
+          ray_hit.ray.tfar[i],
+          glm::vec3(ray_hit.hit.Ng_x[i], ray_hit.hit.Ng_y[i], ray_hit.hit.Ng_z[i]),
+          ray_hit.hit.primID[i],
+          glm::vec2(ray_hit.hit.u[i], ray_hit.hit.v[i]),
+          ray_hit.hit.instID[0][i]);
+    }
+}
+
+void cr::scene::cast_ray_stream(
+  const std::vector<cr::ray> &                rays,
+  std::vector<cr::ray::intersection_record> &records)
+{
+    thread_local auto ray_hits = std::vector<RTCRayHit>();
+
+    ray_hits.resize(rays.size());
+    for (auto i = 0; i < rays.size(); i++) ray_hits[i] = ::make_ray_hit(rays[i]);
+
+    auto ctx = RTCIntersectContext();
+    rtcInitIntersectContext(&ctx);
+    ctx.flags = RTC_INTERSECT_CONTEXT_FLAG_INCOHERENT;
+
+    rtcIntersect1M(
+      _top_level,
+      &ctx,
+      ray_hits.data(),
+      static_cast<unsigned int>(ray_hits.size()),
+      sizeof(RTCRayHit));
+
+    records.resize(rays.size());
+    for (auto i = 0; i < rays.size(); i++)
+    {
+        const auto &ray_hit = ray_hits[i];
+        if (ray_hit.hit.geomID == RTC_INVALID_GEOMETRY_ID)
+        {
+            records[i] = cr::ray::intersection_record();
+            continue;
+        }
+
+        records[i] = _make_record(
+          rays[i],
+          ray_hit.ray.tfar,
+          glm::vec3(ray_hit.hit.Ng_x, ray_hit.hit.Ng_y, ray_hit.hit.Ng_z),
+          ray_hit.hit.primID,
+          glm::vec2(ray_hit.hit.u, ray_hit.hit.v),
+          ray_hit.hit.instID[0]);
+    }
+}
+
+bool cr::scene::occluded(const cr::ray &ray, float tmax)
+{
+    auto ctx = RTCIntersectContext();
+    rtcInitIntersectContext(&ctx);
+    auto occlusion = ::make_ray(ray, tmax);
+
+    rtcOccluded1(_top_level, &ctx, &occlusion);
+
+    // Embree sets tfar to -inf once anything is hit
+    return occlusion.tfar < 0.0f;
+}
+
+void cr::scene::occluded_stream(
+  const std::vector<cr::ray> &rays,
+  float                       tmax,
+  std::vector<uint8_t> &      occluded)
+{
+    thread_local auto occlusions = std::vector<RTCRay>();
+
+    occlusions.resize(rays.size());
+    for (auto i = 0; i < rays.size(); i++) occlusions[i] = ::make_ray(rays[i], tmax);
+
+    auto ctx = RTCIntersectContext();
+    rtcInitIntersectContext(&ctx);
+    ctx.flags = RTC_INTERSECT_CONTEXT_FLAG_INCOHERENT;
+
+    rtcOccluded1M(
+      _top_level,
+      &ctx,
+      occlusions.data(),
+      static_cast<unsigned int>(occlusions.size()),
+      sizeof(RTCRay));
+
+    occluded.resize(rays.size());
+    for (auto i = 0; i < rays.size(); i++)
+        occluded[i] = occlusions[i].tfar < 0.0f;
 }
 
 cr::registry *cr::scene::registry()
@@ -102,6 +548,63 @@ cr::registry *cr::scene::registry()
     return &_entities;
 }
 
+uint64_t cr::scene::fingerprint()
+{
+    auto out = cr::checkpoint::fingerprint();
+
+    const auto add_image = [&out](const cr::image &image)
+    {
+        out.add(image.width());
+        out.add(image.height());
+        if (image.valid())
+            out.add(image.data(), image.width() * image.height() * 4 * sizeof(float));
+    };
+
+    // The same models loaded in the same order are visited in the same order
+    const auto &view =
+      _entities.entities
+        .view<cr::entity::geometry, cr::entity::instances, cr::entity::model_materials>();
+    for (const auto entity : view)
+    {
+        const auto &geometry  = view.get<cr::entity::geometry>(entity);
+        const auto &instances = view.get<cr::entity::instances>(entity);
+        const auto &materials = view.get<cr::entity::model_materials>(entity);
+
+        out.add(*geometry.vert_coords);
+        out.add(*geometry.vert_indices);
+        if (geometry.tex_coords) out.add(*geometry.tex_coords);
+        out.add(instances.transforms);
+        out.add(materials.indices);
+
+        for (const auto &material : materials.materials)
+        {
+            out.add(material.info.shade_type);
+            out.add(material.info.ior);
+            out.add(material.info.roughness);
+            out.add(material.info.reflectiveness);
+            out.add(material.info.emission);
+            out.add(material.info.colour);
+            if (material.info.tex.has_value())
+                add_image(_entities.entities.get<cr::image>(material.info.tex.value()));
+        }
+    }
+
+    if (_skybox.has_value()) add_image(*_skybox);
+    out.add(_skybox_rotation);
+
+    out.add(_sun_enabled);
+    if (_sun_enabled)
+    {
+        const auto sun = _entities.sun();
+        out.add(sun.size);
+        out.add(sun.intensity);
+        out.add(sun.direction);
+        out.add(sun.colour);
+    }
+
+    return out.value();
+}
+
 std::optional<GLuint> cr::scene::skybox_handle() const noexcept
 {
     return _skybox_texture;
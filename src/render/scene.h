@@ -1,13 +1,17 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 #include <random>
+#include <string>
+#include <unordered_map>
 
 #include <embree3/rtcore.h>
 #include <glm/glm.hpp>
 #include <glm/gtx/norm.hpp>
 
 #include <render/ray.h>
+#include <render/environment.h>
 #include <render/material/material.h>
 #include <render/entities/registry.h>
 #include <objects/model.h>
@@ -19,10 +23,39 @@ namespace cr
     class scene
     {
     public:
-        scene() = default;
+        // Settings the shared Embree device is created with, see to_config for the format
+        struct device_settings
+        {
+            uint32_t    threads      = 0;    // Embree's own build threads, 0 lets it decide
+            bool        set_affinity = false;
+            bool        hugepages    = false;
+            std::string isa;    // "sse2", "sse4.2", "avx", "avx2", "avx512", empty for the best available
+
+            // Embree config string, e.g. "threads=8,set_affinity=1,hugepages=1,isa=avx2"
+            [[nodiscard]] std::string to_config() const;
+        };
+
+        explicit scene(const std::string &device_config = "");
+
+        ~scene();
+
+        scene(const scene &) = delete;
+        scene &operator=(const scene &) = delete;
 
         void add_model(const cr::asset_loader::model_data &model);
 
+        // Replaces the instance transforms of a model and rebuilds the top level BVH
+        void set_instances(uint32_t entity, const std::vector<glm::mat4> &transforms);
+
+        /*
+         * Recreates the Embree device every model is built on. All BVHs live on the device, so
+         * they're rebuilt from the geometry kept in the registry. If the config is rejected the
+         * current device is kept and false is returned.
+         */
+        bool set_device_config(const std::string &config);
+
+        [[nodiscard]] const std::string &device_config() const noexcept;
+
         void set_skybox(cr::image &&skybox);
 
         void set_skybox_rotation(const glm::vec2 &rotation);
@@ -31,10 +64,49 @@ namespace cr
 
         [[nodiscard]] glm::vec3 sample_skybox(float x, float y) const noexcept;
 
+        // Direction towards the skybox picked in proportion to its brightness, for light sampling
+        [[nodiscard]] cr::environment_map::direction_sample
+          sample_skybox_direction(const glm::vec2 &uv) const noexcept;
+
+        // Solid angle pdf of sample_skybox_direction, zero while the skybox can't be sampled
+        [[nodiscard]] float skybox_pdf(const glm::vec3 &direction) const noexcept;
+
         [[nodiscard]] cr::ray::intersection_record cast_ray(const cr::ray ray);
 
+        // Closest hit for every valid lane of a coherent packet, e.g. camera rays
+        void cast_ray_packet(
+          const cr::ray_packet &                                          packet,
+          std::array<cr::ray::intersection_record, cr::ray_packet::size> &records);
+
+        // Closest hit for every ray of a batch, used by the wavefront integrator
+        void cast_ray_stream(
+          const std::vector<cr::ray> &                rays,
+          std::vector<cr::ray::intersection_record> &records);
+
+        /*
+         * Whether anything blocks the ray before tmax. Traced with rtcOccluded1, so it stops at
+         * the first hit it finds and never looks up materials or UVs. Alpha cut outs are skipped
+         * by their geometry's filter, the same as for closest hits.
+         */
+        [[nodiscard]] bool
+          occluded(const cr::ray &ray, float tmax = std::numeric_limits<float>::infinity());
+
+        // occluded() for every ray of a batch, traced with rtcOccluded1M
+        void occluded_stream(
+          const std::vector<cr::ray> &rays,
+          float                       tmax,
+          std::vector<uint8_t> &      occluded);
+
+        // Hits the alpha filters have thrown away on the calling thread so far. Embree runs the
+        // filters on the thread that traced the ray, so the difference over some work is its count
+        [[nodiscard]] static uint64_t alpha_skips() noexcept;
+
         [[nodiscard]] cr::registry *registry();
 
+        // Hash of everything the rendered image depends on: geometry, instances, materials and
+        // their textures, the skybox and the sun. Reads every vertex and texel, so it isn't free
+        [[nodiscard]] uint64_t fingerprint();
+
         [[nodiscard]] std::optional<GLuint> skybox_handle() const noexcept;
 
         [[nodiscard]] glm::vec2 skybox_rotation() const noexcept;
@@ -42,12 +114,57 @@ namespace cr
         [[nodiscard]] bool is_sun_enabled() const noexcept;
 
     private:
+        // What an Embree instance ID maps back to, indexed by the instID Embree reports. The
+        // model's components are looked up by entity, pointers into the registry move with it
+        struct instance_info
+        {
+            uint32_t  entity;
+            glm::mat3 normal_matrix;
+        };
+
+        // User data of a model geometry with cut outs, on the heap so the pointer Embree holds stays valid
+        struct alpha_filter
+        {
+            const cr::registry *registry;
+            uint32_t            entity;
+            RTCGeometry         geometry;
+        };
+
+        // Every instance of every model as one RTC_GEOMETRY_TYPE_INSTANCE in a single scene
+        void _build_top_level();
+
+        // Attaches the alpha filters to the model's geometry, if any of its materials can be cut out
+        void _attach_alpha_filter(uint32_t entity);
+
+        [[nodiscard]] bool _has_alpha_materials(const cr::entity::model_materials &materials);
+
+        // Rejects hits on cut out texels, used as both the intersection and occlusion filter
+        static void _filter_alpha(const RTCFilterFunctionNArguments *args);
+
+        [[nodiscard]] cr::ray::intersection_record _make_record(
+          const cr::ray &  ray,
+          float            distance,
+          const glm::vec3 &object_normal,
+          uint32_t         primitive,
+          const glm::vec2 &barycentric,
+          uint32_t         instance) const;
+
+        std::string                _device_config;
+        RTCDevice                  _device    = nullptr;
+        RTCScene                   _top_level = nullptr;
+        std::vector<instance_info> _instances;
+
+        // Keyed by model entity, textures are cached since they're scanned texel by texel
+        std::unordered_map<uint32_t, std::unique_ptr<alpha_filter>> _alpha_filters;
+        std::unordered_map<uint32_t, bool>                          _texture_has_alpha;
+
         bool _sun_enabled = true;
 
         std::optional<cr::image> _skybox;
         std::optional<GLuint>    _skybox_texture;
+        cr::environment_map      _skybox_distribution;
 
-        glm::vec2 _skybox_rotation;
+        glm::vec2 _skybox_rotation = glm::vec2(0.0f, 0.0f);
 
         cr::registry _entities;
     };
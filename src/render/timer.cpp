@@ -4,6 +4,12 @@ cr::timer::timer() { start_time = std::chrono::high_resolution_clock::now(); }
 
 void cr::timer::reset() { start_time = std::chrono::high_resolution_clock::now(); }
 
+void cr::timer::reset(double elapsed)
+{
+    start_time = std::chrono::high_resolution_clock::now() -
+      std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(Duration(elapsed));
+}
+
 void cr::timer::stop() { end_time = std::chrono::high_resolution_clock::now(); }
 
 void cr::timer::frame_start() { frame_start_time = std::chrono::high_resolution_clock::now(); }
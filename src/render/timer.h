@@ -14,6 +14,8 @@ namespace cr
         timer();
 
         void reset();
+        // Restarts as if it had already been running for the given time
+        void reset(double elapsed);
         void stop();
         void frame_start();
         void frame_stop();
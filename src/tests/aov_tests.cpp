@@ -0,0 +1,80 @@
+#include <array>
+#include <random>
+
+#include <render/aov.h>
+#include <tests/tests.h>
+
+namespace
+{
+    [[nodiscard]] glm::vec4 round_trip(cr::aov output, const glm::vec3 &value)
+    {
+        auto buffer = cr::aov_buffer::create(output, 4, 3);
+        buffer.set(2, 1, value);
+
+        auto rgba = glm::vec4();
+        buffer.decode(buffer.pixel(2, 1), 1, &rgba.x);
+        return rgba;
+    }
+}    // namespace
+
+void cr::tests::aov(cr::tests::context &test)
+{
+    const auto size = [](cr::aov output)
+    { return cr::aov_buffer::create(output, 1, 1).pixel_size(); };
+    test.check(size(cr::aov::albedo) == 6, "albedo is three halves");
+    test.check(size(cr::aov::normals) == 4, "normals are two snorm16s");
+    test.check(size(cr::aov::depth) == 4, "depth is one float");
+    test.check(!cr::aov_buffer().allocated(), "a default buffer is unallocated");
+
+    // Octahedral normals, the worst case of snorm16 rounding is well under a thousandth
+    auto rng    = std::mt19937(7);
+    auto normal = std::normal_distribution<float>();
+    auto worst  = 0.0f;
+    auto unit   = true;
+    for (auto i = 0; i < 100000; i++)
+    {
+        const auto direction = glm::normalize(glm::vec3(normal(rng), normal(rng), normal(rng)));
+        const auto decoded   = glm::vec3(::round_trip(cr::aov::normals, direction));
+
+        worst = glm::max(worst, glm::length(decoded - direction));
+        unit  = unit && glm::abs(glm::length(decoded) - 1.0f) < 1e-5f;
+    }
+    test.near(worst, 0.0, 1e-3, "worst octahedral normal error");
+    test.check(unit, "decoded normals are unit length");
+
+    // Both hemispheres and the fold between them
+    for (const auto &axis : std::array<glm::vec3, 6>({
+           glm::vec3(1, 0, 0),
+           glm::vec3(-1, 0, 0),
+           glm::vec3(0, 1, 0),
+           glm::vec3(0, -1, 0),
+           glm::vec3(0, 0, 1),
+           glm::vec3(0, 0, -1),
+         }))
+        test.check(
+          glm::length(glm::vec3(::round_trip(cr::aov::normals, axis)) - axis) < 1e-4f,
+          fmt::format("axis [{}, {}, {}] survives encoding", axis.x, axis.y, axis.z));
+
+    // Halves hold albedos exactly at multiples of 1/1024 and to 11 bits elsewhere
+    const auto albedo = ::round_trip(cr::aov::albedo, glm::vec3(0.25f, 0.5f, 0.75f));
+    test.check(albedo == glm::vec4(0.25f, 0.5f, 0.75f, 1.0f), "albedo stored exactly");
+
+    const auto third = ::round_trip(cr::aov::albedo, glm::vec3(1.0f / 3.0f, 0.1f, 0.9f));
+    test.near(third.x, 1.0 / 3.0, 5e-4, "albedo of a third");
+    test.near(third.y, 0.1, 1e-4, "albedo of 0.1");
+    test.near(third.z, 0.9, 5e-4, "albedo of 0.9");
+
+    // One channel outputs are repeated across RGB
+    const auto depth = ::round_trip(cr::aov::depth, glm::vec3(0.123456f));
+    test.check(depth == glm::vec4(0.123456f, 0.123456f, 0.123456f, 1.0f), "depth stored exactly");
+
+    // Decoding a run of pixels steps by the pixel size
+    auto buffer = cr::aov_buffer::create(cr::aov::albedo, 3, 1);
+    for (auto x = 0; x < 3; x++) buffer.set(x, 0, glm::vec3(static_cast<float>(x) * 0.25f));
+
+    auto row = std::array<float, 12>();
+    buffer.decode(buffer.pixel(0, 0), 3, row.data());
+    test.check(
+      row[0] == 0.0f && row[4] == 0.25f && row[8] == 0.5f && row[11] == 1.0f,
+      "a row decodes pixel by pixel");
+}
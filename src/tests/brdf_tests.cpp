@@ -0,0 +1,100 @@
+#include <array>
+#include <random>
+
+#include <render/brdf.h>
+#include <tests/tests.h>
+
+namespace
+{
+    constexpr auto roughnesses = std::array<float, 4>({ 0.2f, 0.5f, 0.7f, 1.0f });
+
+    // Head on, half way down and grazing
+    const auto views = std::array<glm::vec3, 3>({
+      glm::vec3(0.0f, 0.0f, 1.0f),
+      glm::normalize(glm::vec3(1.0f, 0.0f, 1.0f)),
+      glm::normalize(glm::vec3(0.0f, 1.0f, 0.15f)),
+    });
+
+    const auto normal = glm::vec3(0.0f, 0.0f, 1.0f);
+    const auto f0     = glm::vec3(0.9f, 0.6f, 0.3f);
+
+    // Uniformly over the hemisphere, the solid angle integrals of the BSDF and of its pdf
+    struct quadrature
+    {
+        glm::dvec3 reflected;
+        double     pdf;
+    };
+
+    [[nodiscard]] quadrature integrate(const glm::vec3 &view, float roughness)
+    {
+        constexpr auto count = 400000;
+
+        auto rng     = std::mt19937(5);
+        auto uniform = std::uniform_real_distribution<float>(0.0f, 1.0f);
+        auto out     = quadrature();
+        for (auto i = 0; i < count; i++)
+        {
+            const auto cos_theta = uniform(rng);
+            const auto sin_theta = glm::sqrt(1.0f - cos_theta * cos_theta);
+            const auto phi       = cr::numbers<float>::tau * uniform(rng);
+            const auto light =
+              glm::vec3(sin_theta * glm::cos(phi), sin_theta * glm::sin(phi), cos_theta);
+
+            out.reflected += glm::dvec3(cr::brdf::ggx(view, light, ::normal, roughness, ::f0));
+            out.pdf += cr::brdf::ggx_pdf(view, light, ::normal, roughness);
+        }
+
+        // Over the hemisphere's 2 pi steradians
+        out.reflected *= cr::numbers<double>::tau / count;
+        out.pdf *= cr::numbers<double>::tau / count;
+        return out;
+    }
+}    // namespace
+
+void cr::tests::brdf(cr::tests::context &test)
+{
+    test.check(cr::brdf::ggx_is_mirror(0.0f), "no roughness is a mirror");
+    test.check(!cr::brdf::ggx_is_mirror(0.2f), "some roughness is a lobe");
+
+    for (const auto roughness : ::roughnesses)
+        for (auto v = size_t(0); v < ::views.size(); v++)
+        {
+            const auto &view  = ::views[v];
+            const auto  where = fmt::format("roughness [{}] view [{}]", roughness, v);
+
+            // Some of the visible normals reflect under the surface, the pdf can't sum past one
+            const auto expected = ::integrate(view, roughness);
+            test.check(
+              expected.pdf <= 1.01,
+              fmt::format("pdf integrates to at most one, {}", where));
+
+            // The mean weight of sample_ggx is what the BSDF reflects in all
+            auto rng       = std::mt19937(9);
+            auto uniform   = std::uniform_real_distribution<float>(0.0f, 1.0f);
+            auto reflected = glm::dvec3(0.0);
+            auto agrees    = true;
+            constexpr auto samples = 200000;
+            for (auto i = 0; i < samples; i++)
+            {
+                const auto sample = cr::brdf::sample_ggx(
+                  view,
+                  ::normal,
+                  roughness,
+                  ::f0,
+                  glm::vec2(uniform(rng), uniform(rng)));
+
+                reflected += glm::dvec3(sample.weight);
+                agrees = agrees &&
+                  sample.pdf == cr::brdf::ggx_pdf(view, sample.direction, ::normal, roughness);
+            }
+            reflected /= static_cast<double>(samples);
+
+            test.check(agrees, fmt::format("sample reports its pdf, {}", where));
+            for (auto c = 0; c < 3; c++)
+                test.near(
+                  reflected[c],
+                  expected.reflected[c],
+                  0.02 + 0.02 * expected.reflected[c],
+                  fmt::format("mean weight channel [{}], {}", c, where));
+        }
+}
@@ -0,0 +1,178 @@
+#include <random>
+#include <fstream>
+#include <iterator>
+#include <filesystem>
+
+#include <render/checkpoint.h>
+#include <render/metrics.h>
+#include <tests/tests.h>
+
+namespace
+{
+    // A partial render of a 100x70 image with 32x32 tiles over the region [16, 8) to [90, 70)
+    [[nodiscard]] cr::checkpoint::state make_state()
+    {
+        auto state         = cr::checkpoint::state();
+        state.fingerprint  = 0x0123456789abcdefull;
+        state.width        = 100;
+        state.height       = 70;
+        state.tile_width   = 32;
+        state.tile_height  = 32;
+        state.tile_samples = 4;
+        state.sampler      = 1;
+        state.elapsed      = 12.5;
+        state.first_sample = 128;
+        state.region_min   = glm::ivec2(16, 8);
+        state.region_max   = glm::ivec2(90, 70);
+
+        // Sums of a render that's been running a while, with the sample count in every fourth
+        auto rng    = std::mt19937(3);
+        auto colour = std::uniform_real_distribution<float>(0.0f, 50.0f);
+        state.raw.resize(state.width * state.height * 4);
+        for (auto i = size_t(0); i < state.raw.size(); i++)
+            state.raw[i] = i % 4 == 3 ? 64.0f : colour(rng);
+        state.moments.resize(state.width * state.height);
+        for (auto &moment : state.moments) moment = colour(rng) * colour(rng);
+
+        // Tiles 0 to 2 across, 0 to 2 down
+        const auto tiles = size_t(9);
+        state.progress.assign(tiles, 64);
+        state.retired.assign(tiles, 0);
+        state.retired[4] = 1;
+        state.counters.resize(tiles * cr::metrics::counter_count);
+        for (auto i = size_t(0); i < state.counters.size(); i++) state.counters[i] = i * 977;
+
+        return state;
+    }
+
+    [[nodiscard]] bool same(const cr::checkpoint::state &a, const cr::checkpoint::state &b)
+    {
+        return a.fingerprint == b.fingerprint && a.width == b.width && a.height == b.height &&
+          a.tile_width == b.tile_width && a.tile_height == b.tile_height &&
+          a.tile_samples == b.tile_samples && a.sampler == b.sampler && a.elapsed == b.elapsed &&
+          a.first_sample == b.first_sample && a.region_min == b.region_min &&
+          a.region_max == b.region_max && a.raw == b.raw && a.moments == b.moments &&
+          a.progress == b.progress && a.retired == b.retired && a.counters == b.counters;
+    }
+
+    [[nodiscard]] std::vector<char> contents(const std::filesystem::path &path)
+    {
+        auto file = std::ifstream(path, std::ios::binary);
+        return std::vector<char>(
+          std::istreambuf_iterator<char>(file),
+          std::istreambuf_iterator<char>());
+    }
+
+    void overwrite(const std::filesystem::path &path, const std::vector<char> &bytes)
+    {
+        auto file = std::ofstream(path, std::ios::binary | std::ios::trunc);
+        file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+}    // namespace
+
+void cr::tests::checkpoint(cr::tests::context &test)
+{
+    const auto directory = std::filesystem::temp_directory_path() / "crender-tests";
+    std::filesystem::create_directories(directory);
+    const auto path = (directory / "checkpoint.ckpt").string();
+
+    const auto state = ::make_state();
+    for (const auto compress : { false, true })
+    {
+        const auto name = compress ? "compressed" : "uncompressed";
+
+        test.check(cr::checkpoint::write(path, state, compress), fmt::format("{} write", name));
+        test.check(
+          !std::filesystem::exists(path + ".tmp"),
+          fmt::format("{} write leaves no temporary file", name));
+
+        const auto loaded = cr::checkpoint::read(path);
+        test.check(loaded && ::same(*loaded, state), fmt::format("{} round trip", name));
+    }
+
+    // Byte planes of the sums deflate to well under their raw size
+    test.check(cr::checkpoint::write(path, state, false), "uncompressed write");
+    const auto raw_size = std::filesystem::file_size(path);
+    test.check(cr::checkpoint::write(path, state, true), "compressed write");
+    test.check(std::filesystem::file_size(path) < raw_size, "compression saves space");
+
+    // Damage is refused rather than resumed from
+    for (const auto compress : { false, true })
+    {
+        const auto name = compress ? "compressed" : "uncompressed";
+        test.check(cr::checkpoint::write(path, state, compress), fmt::format("{} write", name));
+        const auto bytes = ::contents(path);
+
+        ::overwrite(path, std::vector<char>(bytes.begin(), bytes.begin() + bytes.size() / 2));
+        test.check(!cr::checkpoint::read(path), fmt::format("{} truncated file refused", name));
+
+        auto bad_magic = bytes;
+        bad_magic[0]   = 'X';
+        ::overwrite(path, bad_magic);
+        test.check(!cr::checkpoint::read(path), fmt::format("{} wrong magic refused", name));
+
+        auto bad_version = bytes;
+        bad_version[4]   = 99;
+        ::overwrite(path, bad_version);
+        test.check(!cr::checkpoint::read(path), fmt::format("{} wrong version refused", name));
+    }
+
+    // Sizes that don't match the resolution and tile grid
+    auto short_raw = state;
+    short_raw.raw.pop_back();
+    test.check(cr::checkpoint::write(path, short_raw, false), "short sums write");
+    test.check(!cr::checkpoint::read(path), "sums not matching the resolution refused");
+
+    auto extra_tile = state;
+    extra_tile.progress.push_back(0);
+    test.check(cr::checkpoint::write(path, extra_tile, false), "extra tile write");
+    test.check(!cr::checkpoint::read(path), "progress not matching the tiles refused");
+
+    auto outside = state;
+    outside.region_max = glm::ivec2(101, 70);
+    test.check(cr::checkpoint::write(path, outside, false), "outside region write");
+    test.check(!cr::checkpoint::read(path), "region outside the image refused");
+
+    test.check(!cr::checkpoint::read((directory / "missing.ckpt").string()), "missing file");
+
+    std::filesystem::remove_all(directory);
+
+    // Two partial renders that each took half the samples of every pixel sum to the whole one,
+    // halves of floats are exact so the sums are too
+    auto first_half = state;
+    for (auto &value : first_half.raw) value *= 0.5f;
+    for (auto &moment : first_half.moments) moment *= 0.5f;
+    first_half.elapsed *= 0.5;
+    auto merged = first_half;
+    test.check(cr::checkpoint::merge(merged, first_half), "halves merge");
+    test.check(
+      merged.raw == state.raw && merged.moments == state.moments &&
+        merged.elapsed == state.elapsed,
+      "merged halves sum to the whole render");
+
+    auto other_frame = first_half;
+    other_frame.fingerprint++;
+    test.check(!cr::checkpoint::merge(merged, other_frame), "another frame isn't merged");
+
+    auto other_size = first_half;
+    other_size.width++;
+    test.check(!cr::checkpoint::merge(merged, other_size), "another resolution isn't merged");
+    test.check(merged.raw == state.raw, "a refused merge leaves the sums alone");
+
+    // The fingerprint is order sensitive and covers every byte
+    auto first = cr::checkpoint::fingerprint();
+    first.add(uint32_t(1));
+    first.add(uint32_t(2));
+    auto second = cr::checkpoint::fingerprint();
+    second.add(uint32_t(2));
+    second.add(uint32_t(1));
+    test.check(first.value() != second.value(), "fingerprint depends on order");
+
+    auto odd       = std::vector<uint8_t>(13, 0);
+    auto unchanged = cr::checkpoint::fingerprint();
+    unchanged.add(odd);
+    odd.back()   = 1;
+    auto changed = cr::checkpoint::fingerprint();
+    changed.add(odd);
+    test.check(unchanged.value() != changed.value(), "fingerprint covers trailing bytes");
+}
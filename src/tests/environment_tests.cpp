@@ -0,0 +1,117 @@
+#include <random>
+
+#include <render/environment.h>
+#include <util/numbers.h>
+#include <tests/tests.h>
+
+namespace
+{
+    constexpr auto width  = uint64_t(64);
+    constexpr auto height = uint64_t(32);
+
+    // Turned a quarter around and tilted, as the skybox rotation sliders would
+    const auto rotation = glm::vec2(0.25f, 0.1f);
+
+    // Brightness between 0.5 and 2 everywhere, no texel is black and none dominates
+    [[nodiscard]] cr::image gradient_sky()
+    {
+        auto sky = cr::image(width, height);
+        for (auto y = uint64_t(0); y < height; y++)
+            for (auto x = uint64_t(0); x < width; x++)
+            {
+                const auto u = static_cast<float>(x) / width;
+                const auto v = static_cast<float>(y) / height;
+                sky.set(x, y, glm::vec3(0.5f + 1.5f * u * v, 0.5f + u, 0.5f + v));
+            }
+        return sky;
+    }
+
+    // Black apart from a small bright patch, like a sun painted into the skybox
+    [[nodiscard]] cr::image patch_sky()
+    {
+        auto sky = cr::image(width, height);
+        for (auto y = uint64_t(0); y < height; y++)
+            for (auto x = uint64_t(0); x < width; x++)
+            {
+                const auto lit = x >= 40 && x < 44 && y >= 10 && y < 13;
+                sky.set(x, y, glm::vec3(lit ? 100.0f : 0.0f));
+            }
+        return sky;
+    }
+
+    // The uv square in cells, the midpoint of each weighted by the sphere's 2 pi^2 sin(theta)
+    [[nodiscard]] double integrate_pdf(const cr::environment_map &map)
+    {
+        constexpr auto columns = 1024;
+        constexpr auto rows    = 512;
+        constexpr auto pi      = cr::numbers<double>::pi;
+
+        auto sum = 0.0;
+        for (auto y = 0; y < rows; y++)
+            for (auto x = 0; x < columns; x++)
+            {
+                const auto uv = glm::vec2((x + 0.5f) / columns, (y + 0.5f) / rows);
+                const auto direction = cr::environment_map::to_direction(uv);
+                const auto jacobian  = 2.0 * pi * pi * glm::sin(pi * uv.y);
+
+                sum += map.pdf(direction, ::rotation) * jacobian;
+            }
+        return sum / (columns * rows);
+    }
+}    // namespace
+
+void cr::tests::environment(cr::tests::context &test)
+{
+    // Directions and uvs are inverses away from the poles
+    auto mapped = true;
+    for (const auto &uv : { glm::vec2(0.1f, 0.2f), glm::vec2(0.6f, 0.5f), glm::vec2(0.9f, 0.8f) })
+        mapped = mapped &&
+          glm::length(cr::environment_map::to_uv(cr::environment_map::to_direction(uv)) - uv) <
+            1e-5f;
+    test.check(mapped, "uv to direction and back");
+
+    const auto sky = cr::environment_map(::gradient_sky(), ::rotation.y);
+    test.check(!sky.empty(), "a lit skybox can be sampled");
+    test.near(::integrate_pdf(sky), 1.0, 1e-2, "pdf integrates to one over the sphere");
+
+    // Every direction has some light, the mean of 1 / pdf is the area of the sphere
+    auto rng     = std::mt19937(11);
+    auto uniform = std::uniform_real_distribution<float>(0.0f, 1.0f);
+    auto agrees  = true;
+    auto zeros   = 0;
+    auto area    = 0.0;
+    constexpr auto samples = 200000;
+    for (auto i = 0; i < samples; i++)
+    {
+        const auto sample = sky.sample(glm::vec2(uniform(rng), uniform(rng)), ::rotation);
+        agrees = agrees && sample.pdf == sky.pdf(sample.direction, ::rotation);
+
+        // Directions rounded onto a pole have no density and are dropped by the renderer
+        zeros += sample.pdf <= 0.0f;
+        area += sample.pdf > 0.0f ? 1.0 / sample.pdf : 0.0;
+    }
+    test.check(agrees, "sample reports the pdf of the direction it picked");
+    test.check(zeros < samples / 10000, "samples without a density are rare");
+    test.near(area / samples, 4.0 * cr::numbers<double>::pi, 1e-2, "mean of 1 / pdf");
+
+    // Samples land where the rotated lookup finds light, on a skybox that's mostly black
+    const auto patch_image = ::patch_sky();
+    const auto patch       = cr::environment_map(patch_image, ::rotation.y);
+    test.near(::integrate_pdf(patch), 1.0, 2e-2, "pdf of a small patch integrates to one");
+
+    auto on_patch = true;
+    for (auto i = 0; i < 10000; i++)
+    {
+        const auto sample = patch.sample(glm::vec2(uniform(rng), uniform(rng)), ::rotation);
+        const auto uv     = cr::environment_map::to_uv(sample.direction) + ::rotation;
+        on_patch = on_patch && sample.pdf > 0.0f && patch_image.get_uv(uv.x, uv.y).x > 0.0f;
+    }
+    test.check(on_patch, "samples land on the lit patch with the skybox rotated");
+
+    // Nothing to sample on a black skybox, or without one
+    const auto black = cr::environment_map(cr::image(std::vector<float>(16 * 8 * 4), 16, 8), 0.0f);
+    test.check(black.empty(), "a black skybox is empty");
+    test.check(black.pdf(glm::vec3(1, 0, 0), ::rotation) == 0.0f, "pdf of a black skybox");
+    test.check(black.sample(glm::vec2(0.5f), ::rotation).pdf == 0.0f, "sample of a black skybox");
+    test.check(cr::environment_map().empty(), "a default map is empty");
+}
@@ -0,0 +1,53 @@
+#include <array>
+
+#include <tests/tests.h>
+
+namespace
+{
+    struct suite
+    {
+        const char *name;
+        void (*run)(cr::tests::context &);
+    };
+
+    constexpr auto suites = std::array<suite, 5>({
+      suite { "sampler", cr::tests::sampler },
+      suite { "aov", cr::tests::aov },
+      suite { "checkpoint", cr::tests::checkpoint },
+      suite { "environment", cr::tests::environment },
+      suite { "brdf", cr::tests::brdf },
+    });
+}    // namespace
+
+// Runs the suite named on the command line, or all of them without one. Exits non zero if a
+// check failed, so every suite can be its own ctest test
+int main(int argc, char **argv)
+{
+    const auto only = argc > 1 ? std::string(argv[1]) : std::string();
+
+    auto ran    = 0;
+    auto failed = false;
+    for (const auto &suite : ::suites)
+    {
+        if (!only.empty() && only != suite.name) continue;
+
+        auto test = cr::tests::context(suite.name);
+        suite.run(test);
+        fmt::print(
+          "[{}] passed [{}/{}] checks\n",
+          suite.name,
+          test.checks() - test.failures(),
+          test.checks());
+
+        ran++;
+        failed = failed || test.failures() != 0;
+    }
+
+    if (ran == 0)
+    {
+        fmt::print("No test suite named [{}]\n", only);
+        return 1;
+    }
+
+    return failed ? 1 : 0;
+}
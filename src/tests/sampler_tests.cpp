@@ -0,0 +1,109 @@
+#include <set>
+#include <array>
+#include <cmath>
+
+#include <render/sampler.h>
+#include <tests/tests.h>
+
+namespace
+{
+    constexpr auto types = std::array<cr::sampler::type, 3>({
+      cr::sampler::type::random,
+      cr::sampler::type::sobol,
+      cr::sampler::type::blue_noise,
+    });
+
+    [[nodiscard]] const char *type_name(cr::sampler::type type) noexcept
+    {
+        switch (type)
+        {
+        case cr::sampler::type::random: return "random";
+        case cr::sampler::type::sobol: return "sobol";
+        case cr::sampler::type::blue_noise: return "blue-noise";
+        }
+
+        return "unknown";
+    }
+
+    // Numbers stay in [0, 1) and are pure functions of pixel, sample and dimension, renders of
+    // separate sample ranges only merge if they are
+    void check_range_and_repeatability(cr::tests::context &test, cr::sampler::type type)
+    {
+        const auto sampler = cr::sampler::create(type);
+        const auto again   = cr::sampler::create(type);
+
+        auto in_range   = true;
+        auto repeatable = true;
+        for (auto y = 0u; y < 8; y++)
+            for (auto x = 0u; x < 8; x++)
+                for (auto sample = uint64_t(0); sample < 64; sample++)
+                    for (auto dimension = 0u; dimension < 16; dimension += 2)
+                    {
+                        const auto pixel = glm::uvec2(x, y);
+                        const auto value = sampler->get_2d(pixel, sample, dimension);
+
+                        in_range = in_range && value.x >= 0.0f && value.x < 1.0f &&
+                          value.y >= 0.0f && value.y < 1.0f;
+                        repeatable = repeatable &&
+                          value == again->get_2d(pixel, sample, dimension) &&
+                          value.x == sampler->get(pixel, sample, dimension);
+                    }
+
+        test.check(in_range, fmt::format("{} numbers in [0, 1)", ::type_name(type)));
+        test.check(repeatable, fmt::format("{} numbers repeat", ::type_name(type)));
+    }
+
+    // The first 2^k samples of a Sobol pixel put exactly one sample in each of 2^k strata along
+    // either axis, and form a (0, 2) net over a square grid
+    void check_stratification(cr::tests::context &test, cr::sampler::type type)
+    {
+        const auto sampler = cr::sampler::create(type);
+
+        for (const auto count : { 16u, 64u, 256u })
+        {
+            const auto side = static_cast<uint32_t>(std::sqrt(count));
+
+            auto stratified = true;
+            for (auto pixel = 0u; pixel < 16 && stratified; pixel++)
+                for (auto dimension = 0u; dimension < 8 && stratified; dimension += 2)
+                {
+                    auto rows    = std::set<uint32_t>();
+                    auto columns = std::set<uint32_t>();
+                    auto cells   = std::set<uint32_t>();
+                    for (auto sample = uint64_t(0); sample < count; sample++)
+                    {
+                        const auto value =
+                          sampler->get_2d(glm::uvec2(pixel, pixel * 7), sample, dimension);
+                        const auto x = static_cast<uint32_t>(value.x * count);
+                        const auto y = static_cast<uint32_t>(value.y * count);
+
+                        columns.insert(x);
+                        rows.insert(y);
+                        cells.insert(x / side + y / side * side);
+                    }
+
+                    stratified = columns.size() == count && rows.size() == count &&
+                      cells.size() == count;
+                }
+
+            test.check(
+              stratified,
+              fmt::format("{} stratifies the first [{}] samples", ::type_name(type), count));
+        }
+    }
+}    // namespace
+
+void cr::tests::sampler(cr::tests::context &test)
+{
+    for (const auto type : ::types) ::check_range_and_repeatability(test, type);
+
+    ::check_stratification(test, cr::sampler::type::sobol);
+
+    // Neighbouring pixels have to be decorrelated, the same sequence everywhere would show as
+    // structured noise
+    const auto sobol = cr::sampler::create(cr::sampler::type::sobol);
+    auto       equal = 0;
+    for (auto x = 1u; x < 64; x++)
+        equal += sobol->get(glm::uvec2(x, 0), 0, 0) == sobol->get(glm::uvec2(0, 0), 0, 0);
+    test.check(equal == 0, "sobol pixels are scrambled apart");
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cmath>
+#include <string>
+#include <cstdint>
+#include <utility>
+
+#include <fmt/core.h>
+
+namespace cr::tests
+{
+    // Collects the checks of one suite, a failed check is printed and the suite carries on
+    class context
+    {
+    public:
+        explicit context(std::string suite) : _suite(std::move(suite)) { }
+
+        bool check(bool condition, const std::string &what)
+        {
+            _checks++;
+            if (condition) return true;
+
+            _failures++;
+            fmt::print("[{}] failed: {}\n", _suite, what);
+            return false;
+        }
+
+        // Within tolerance of expected, relative to it once it's larger than one
+        bool near(double actual, double expected, double tolerance, const std::string &what)
+        {
+            const auto scale = std::abs(expected) > 1.0 ? std::abs(expected) : 1.0;
+            return check(
+              std::abs(actual - expected) <= tolerance * scale,
+              fmt::format("{}, got [{}] not [{}] +- [{}]", what, actual, expected, tolerance));
+        }
+
+        [[nodiscard]] uint64_t checks() const noexcept
+        {
+            return _checks;
+        }
+
+        [[nodiscard]] uint64_t failures() const noexcept
+        {
+            return _failures;
+        }
+
+    private:
+        std::string _suite;
+        uint64_t    _checks   = 0;
+        uint64_t    _failures = 0;
+    };
+
+    // One per <name>_tests.cpp, main.cpp lists them
+    void sampler(context &test);
+    void aov(context &test);
+    void checkpoint(context &test);
+    void environment(context &test);
+    void brdf(context &test);
+}    // namespace cr::tests
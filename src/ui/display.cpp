@@ -1,11 +1,5 @@
 #include "display.h"
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <stb/stbi_image_write.h>
-
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb/stb_image.h>
-
 cr::display::display()
 {
     glfwSetErrorCallback([](int error, const char *description) {
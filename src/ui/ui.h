@@ -271,6 +271,13 @@ namespace cr::ui
         ImGui::End();
     }
 
+    // Part of the render the scene preview shows, in the renderer's pixels
+    inline auto viewport_min = glm::ivec2(0, 0);
+    inline auto viewport_max = glm::ivec2(0, 0);
+
+    inline auto prioritise_viewport       = true;
+    inline auto viewport_priority_samples = int(32);
+
     inline void scene_preview(
       cr::renderer *      renderer,
       cr::draft_renderer *draft_renderer,
@@ -327,6 +334,39 @@ namespace cr::ui
               glm::value_ptr(scene->registry()->camera()->mat4()));
 
             glUniform1i(glGetUniformLocation(compute_program, "flip"), in_draft_mode);
+
+            // Same mapping as scene_zoom.comp, the render is stored flipped
+            const auto resolution = glm::vec2(renderer->current_resolution());
+            const auto window     = glm::vec2(window_size.x, window_size.y);
+            const auto shown_min  = glm::clamp(
+              current_translation * current_zoom,
+              glm::vec2(0.0f),
+              resolution);
+            const auto shown_max = glm::clamp(
+              (current_translation + window) * current_zoom,
+              glm::vec2(0.0f),
+              resolution);
+            viewport_min = glm::ivec2(glm::floor(resolution - shown_max));
+            viewport_max = glm::ivec2(glm::ceil(resolution - shown_min));
+
+            // Only worth it while zoomed in, and only passed on when it changes since every
+            // change restarts the renderer's scheduling
+            const auto zoomed = viewport_min != glm::ivec2(0, 0) ||
+              viewport_max != renderer->current_resolution();
+            const auto interest = prioritise_viewport && zoomed && !in_draft_mode
+              ? glm::ivec4(viewport_min, viewport_max)
+              : glm::ivec4(0);
+            static auto applied_interest = glm::ivec4(0);
+            static auto applied_samples  = 0;
+            if (interest != applied_interest || viewport_priority_samples != applied_samples)
+            {
+                renderer->set_region_of_interest(
+                  glm::ivec2(interest.x, interest.y),
+                  glm::ivec2(interest.z, interest.w),
+                  viewport_priority_samples);
+                applied_interest = interest;
+                applied_samples  = viewport_priority_samples;
+            }
         }
 
         {
@@ -355,19 +395,24 @@ namespace cr::ui
             }
             else
             {
-                const auto current_progress = renderer->current_progress();
-                // Upload rendered scene to GPU
+                // Only upload the rendered scene to the GPU when there's a new frame
+                static auto uploaded = std::shared_ptr<const cr::renderer::frame>();
+                const auto  frame    = renderer->snapshot();
                 glBindTexture(GL_TEXTURE_2D, scene_texture);
-                glTexImage2D(
-                  GL_TEXTURE_2D,
-                  0,
-                  GL_RGBA8,
-                  current_progress->width(),
-                  current_progress->height(),
-                  0,
-                  GL_RGBA,
-                  GL_FLOAT,
-                  current_progress->data());
+                if (frame != uploaded)
+                {
+                    glTexImage2D(
+                      GL_TEXTURE_2D,
+                      0,
+                      GL_RGBA8,
+                      frame->colour.width(),
+                      frame->colour.height(),
+                      0,
+                      GL_RGBA,
+                      GL_FLOAT,
+                      frame->colour.data());
+                    uploaded = frame;
+                }
                 glActiveTexture(GL_TEXTURE0);
                 glBindTexture(GL_TEXTURE_2D, scene_texture);
             }
@@ -416,18 +461,165 @@ namespace cr::ui
         }
         ImGui::InputInt("Thread Count", &thread_count);
 
+        static auto tile_size    = glm::ivec2(32, 32);
+        static auto tile_samples = int(1);
+        ImGui::InputInt2("Tile Size", glm::value_ptr(tile_size));
+        ImGui::InputInt("Samples Per Tile (?)", &tile_samples);
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip(
+              "How many samples a tile renders before the image updates, higher is faster");
+        tile_samples = glm::max(tile_samples, 1);
+
+        static auto error_threshold  = 0.0f;
+        static auto adaptive_min_spp = int(16);
+        ImGui::InputFloat("Adaptive Error Threshold (?)", &error_threshold, 0.005f, 0.05f, "%.3f");
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip(
+              "Tiles stop sampling once their relative error drops below this, 0 disables it");
+        ImGui::InputInt("Adaptive Min Samples", &adaptive_min_spp);
+        error_threshold  = glm::max(error_threshold, 0.0f);
+        adaptive_min_spp = glm::max(adaptive_min_spp, 2);
+
+        static auto profiling = false;
+        ImGui::Checkbox("Profile Stages (?)", &profiling);
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Times tracing, shading and accumulation separately, slightly slower");
+
+        static auto roulette       = true;
+        static auto roulette_depth = int(3);
+        ImGui::Checkbox("Russian Roulette (?)", &roulette);
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip(
+              "Randomly ends dim paths early, survivors are weighted up so the result is the same");
+        ImGui::InputInt("Roulette Min Depth", &roulette_depth);
+        roulette_depth = glm::max(roulette_depth, 1);
+
+        static auto reprojection = false;
+        static auto max_history  = int(16);
+        ImGui::Checkbox("Reprojection (?)", &reprojection);
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip(
+              "Keeps the samples of surfaces still in view when the camera moves, capped at the "
+              "max history");
+        ImGui::InputInt("Max History Samples", &max_history);
+        max_history = glm::max(max_history, 1);
+
+        ImGui::Checkbox("Prioritise Viewport (?)", &prioritise_viewport);
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip(
+              "While zoomed in, the visible tiles get this many samples before the rest get any");
+        ImGui::InputInt("Viewport Samples", &viewport_priority_samples);
+        viewport_priority_samples = glm::max(viewport_priority_samples, 1);
+
+        if (ImGui::Button("Crop To Viewport"))
+            renderer->update([renderer]() { renderer->set_region(viewport_min, viewport_max); });
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Renders only what the scene preview shows, for final renders");
+        ImGui::SameLine();
+        if (ImGui::Button("Clear Crop"))
+            renderer->update([renderer]()
+                             { renderer->set_region(glm::ivec2(0, 0), glm::ivec2(0, 0)); });
+
+        static auto progressive_preview = true;
+        ImGui::Checkbox("Progressive Preview (?)", &progressive_preview);
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip(
+              "Shows a quarter and then a half resolution image first whenever the render restarts");
+
+        static const auto integrators =
+          std::array<std::string, 2>({ "Path", "Wavefront" });
+
+        static auto current_integrator = 0;
+
+        if (ImGui::BeginCombo("Integrator (?)", integrators[current_integrator].c_str()))
+        {
+            for (auto i = 0; i < integrators.size(); i++)
+                if (ImGui::Button(integrators[i].c_str())) current_integrator = i;
+            ImGui::EndCombo();
+        }
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip(
+              "Path traces each pixel on its own, Wavefront traces a whole tile one bounce at a time");
+
+        static const auto samplers =
+          std::array<std::string, 3>({ "Random", "Sobol", "Blue Noise" });
+
+        static auto current_sampler = 1;
+
+        if (ImGui::BeginCombo("Sampler (?)", samplers[current_sampler].c_str()))
+        {
+            for (auto i = 0; i < samplers.size(); i++)
+                if (ImGui::Button(samplers[i].c_str())) current_sampler = i;
+            ImGui::EndCombo();
+        }
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip(
+              "Sobol converges fastest per sample, Blue Noise spreads the remaining noise out evenly");
+
         if (ImGui::Button("Update"))
         {
             renderer->update(
               [renderer, draft_renderer, &pool]()
               {
                   renderer->set_max_bounces(bounces);
+                  renderer->set_tile_size(tile_size.x, tile_size.y);
+                  renderer->set_tile_samples(tile_samples);
+                  renderer->set_integrator(
+                    current_integrator == 0 ? cr::renderer::integrator::path
+                                            : cr::renderer::integrator::wavefront);
+                  renderer->set_adaptive_sampling(error_threshold, adaptive_min_spp);
+                  renderer->set_russian_roulette(roulette, roulette_depth);
+                  renderer->set_reprojection(reprojection, max_history);
+                  renderer->set_progressive_preview(progressive_preview);
+                  renderer->set_profiling(profiling);
+                  renderer->set_sampler(
+                    current_sampler == 0      ? cr::sampler::type::random
+                      : current_sampler == 1  ? cr::sampler::type::sobol
+                                              : cr::sampler::type::blue_noise);
                   renderer->set_resolution(resolution.x, resolution.y);
                   draft_renderer->set_resolution(resolution.x, resolution.y);
                   pool = std::make_unique<cr::thread_pool>(thread_count);
               });
         }
 
+        ImGui::NewLine();
+        ImGui::Separator();
+
+        static const auto device_isas = std::array<std::string, 6>(
+          { "Best available", "sse2", "sse4.2", "avx", "avx2", "avx512" });
+
+        static auto device         = cr::scene::device_settings();
+        static auto device_threads = int(0);
+        static auto current_isa    = 0;
+
+        ImGui::Text("Embree Device");
+        ImGui::InputInt("Build Threads (?)", &device_threads);
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Threads Embree uses to build BVHs, 0 uses every hardware thread");
+        ImGui::Checkbox("Set Affinity", &device.set_affinity);
+        ImGui::Checkbox("Huge Pages (?)", &device.hugepages);
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Allocates BVH memory in 2MB pages, faster for big scenes if the OS allows it");
+        if (ImGui::BeginCombo("ISA", device_isas[current_isa].c_str()))
+        {
+            for (auto i = 0; i < device_isas.size(); i++)
+                if (ImGui::Button(device_isas[i].c_str())) current_isa = i;
+            ImGui::EndCombo();
+        }
+
+        device.threads = static_cast<uint32_t>(glm::max(device_threads, 0));
+        device.isa     = current_isa == 0 ? std::string() : device_isas[current_isa];
+
+        ImGui::Text("%s", fmt::format("Current config: [{}]", scene->device_config()).c_str());
+        if (ImGui::Button("Recreate Device"))
+        {
+            renderer->update([scene, config = device.to_config()]()
+                             { static_cast<void>(scene->set_device_config(config)); });
+        }
+
+        ImGui::NewLine();
+        ImGui::Separator();
+
         ImGui::Text(
           "%s",
           fmt::format("Current sample count: [{}]", renderer->current_sample_count()).c_str());
@@ -453,12 +645,24 @@ namespace cr::ui
             else
                 cr::logger::warn("Cannot start the renderer when it's started");
         }
-        static auto target_spp = int(0);
-        ImGui::Text("Target Sample Count (?)");
+        static auto target_spp   = int(0);
+        static auto time_budget  = 0.0f;
+        static auto error_budget = 0.0f;
+        ImGui::Text("Budget (?)");
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Rendering stops at whichever limit is reached first, 0 for no limit");
         ImGui::InputInt("Count", &target_spp, 16, 64);
         if (ImGui::IsItemHovered())
-            ImGui::SetTooltip("Set amount of samples per pixel you want to render, 0 for no limit");
-        if (ImGui::Button("Set target sample count")) renderer->set_target_spp(target_spp);
+            ImGui::SetTooltip("Set amount of samples per pixel you want to render");
+        ImGui::InputFloat("Seconds", &time_budget, 10.0f, 60.0f);
+        ImGui::InputFloat("Error", &error_budget, 0.001f, 0.01f, "%.4f");
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Mean relative error of the image to stop at");
+        target_spp   = glm::max(target_spp, 0);
+        time_budget  = glm::max(time_budget, 0.0f);
+        error_budget = glm::max(error_budget, 0.0f);
+        if (ImGui::Button("Set budget"))
+            renderer->set_budget({ time_budget, static_cast<uint64_t>(target_spp), error_budget });
 
         {
             ImGui::Text("Sun");
@@ -556,14 +760,22 @@ namespace cr::ui
         static auto export_albedo = false;
         static auto export_normal = false;
         static auto export_depth  = false;
+        static auto export_error  = false;
         static auto denoise       = true;
         static auto post_process  = true;
         ImGui::Checkbox("Export Albedo", &export_albedo);
         ImGui::Checkbox("Export Normal", &export_normal);
         ImGui::Checkbox("Export Depth", &export_depth);
+        ImGui::Checkbox("Export Error", &export_error);
         ImGui::Checkbox("Denoise", &denoise);
         ImGui::Checkbox("Post Process", &post_process);
 
+        // Only the outputs that are going to be exported get rendered
+        renderer->get()->set_aov_enabled(cr::aov::albedo, export_albedo || denoise);
+        renderer->get()->set_aov_enabled(cr::aov::normals, export_normal || denoise);
+        renderer->get()->set_aov_enabled(cr::aov::depth, export_depth);
+        renderer->get()->set_aov_enabled(cr::aov::error, export_error);
+
         if (ImGui::Button("Save"))
         {
             cr::logger::info("Starting to export image [{}]", file_string.data());
@@ -571,9 +783,11 @@ namespace cr::ui
 
             auto file_str = std::string(file_string.data());
 
-            const auto data = renderer->get()->current_progress();
+            // One snapshot for everything, so every output comes from the same samples
+            const auto frame = renderer->get()->snapshot();
 
-            auto folder = export_albedo || export_normal || export_depth || denoise || post_process;
+            auto folder = export_albedo || export_normal || export_depth || export_error || denoise ||
+              post_process;
 
             if (folder)
             {
@@ -581,34 +795,37 @@ namespace cr::ui
                 file_str = file_str + "\\sample";
             }
 
-            cr::asset_loader::export_framebuffer(*data, file_str.data(), selected_type);
+            cr::asset_loader::export_framebuffer(frame->colour, file_str.data(), selected_type);
 
             if (export_albedo)
                 cr::asset_loader::export_framebuffer(
-                  *renderer->get()->current_albedos(),
+                  frame->albedo,
                   file_str + "-albedos",
                   asset_loader::image_type::JPG);
 
             if (export_normal)
                 cr::asset_loader::export_framebuffer(
-                  *renderer->get()->current_normals(),
+                  frame->normals,
                   file_str + "-normals",
                   asset_loader::image_type::JPG);
 
             if (export_depth)
                 cr::asset_loader::export_framebuffer(
-                  *renderer->get()->current_depths(),
+                  frame->depth,
                   file_str + "-depth",
                   asset_loader::image_type::JPG);
 
-            auto to_post = *data;
+            if (export_error)
+                cr::asset_loader::export_framebuffer(
+                  frame->error,
+                  file_str + "-error",
+                  asset_loader::image_type::EXR);
+
+            auto to_post = frame->colour;
             if (denoise)
             {
-                const auto denoised = cr::denoise(
-                  renderer->get()->current_progress(),
-                  renderer->get()->current_normals(),
-                  renderer->get()->current_albedos(),
-                  selected_type);
+                const auto denoised =
+                  cr::denoise(&frame->colour, &frame->normals, &frame->albedo, selected_type);
 
                 if (post_process) to_post = denoised;
 
@@ -848,11 +1065,19 @@ namespace cr::ui
                 switch (material.info.shade_type)
                 {
                 case material::metal:
-                    //                    ImGui::SliderFloat(
-                    //                      ("Roughness##" + material.info.name).c_str(),
-                    //                      &material.info.roughness,
-                    //                      0,
-                    //                      1);
+                    if (
+                      widgets::slider_float_input(
+                        "Roughness##" + material.info.name,
+                        material.info.roughness,
+                        0,
+                        1) &&
+                      any_selection && selected)
+                    {
+                        for (auto j = 0; j < found_material_indices.size(); j++)
+                            if (found_material_selected[j])
+                                materials[found_material_indices[j]].info.roughness =
+                                  material.info.roughness;
+                    }
                     if (
                       widgets::slider_float_input(
                         "Reflectiveness##" + material.info.name,
@@ -1057,9 +1282,67 @@ namespace cr::ui
         ImGui::Text(
           "%s",
           fmt::format("Samples per second: [{}]", stats.samples_per_second).c_str());
+        ImGui::Text(
+          "%s",
+          fmt::format(
+            "Samples: [{}] (average [{:.1f}])",
+            renderer->current_sample_count(),
+            stats.average_samples)
+            .c_str());
         ImGui::Text("%s", fmt::format("Total Rays Fired: [{}]", stats.total_rays).c_str());
+        ImGui::Text("%s", fmt::format("Retired Tiles: [{}]", stats.retired_tiles).c_str());
         ImGui::Text("%s", fmt::format("Running Time: [{}]", stats.running_time).c_str());
 
+        const auto eta = renderer->current_eta();
+        ImGui::Text("%s", fmt::format("Estimated Error: [{:.4f}]", eta.error).c_str());
+        if (eta.limiting != cr::renderer::render_eta::limit::none)
+            ImGui::Text(
+              "%s",
+              fmt::format(
+                "ETA: [{:.1f}s] ({})",
+                eta.seconds,
+                cr::renderer::render_eta::name(eta.limiting))
+                .c_str());
+
+        if (ImGui::TreeNode("Counters"))
+        {
+            using cr::metrics::counter;
+
+            const auto &counters = stats.counters;
+            ImGui::Text(
+              "%s",
+              fmt::format(
+                "Camera / Bounce / Shadow Rays: [{}] / [{}] / [{}]",
+                counters[counter::camera_rays],
+                counters[counter::bounce_rays],
+                counters[counter::shadow_rays])
+                .c_str());
+            ImGui::Text("%s", fmt::format("Misses: [{}]", counters[counter::misses]).c_str());
+            ImGui::Text(
+              "%s",
+              fmt::format("Alpha Skips: [{}]", counters[counter::alpha_skips]).c_str());
+            ImGui::Text(
+              "%s",
+              fmt::format("Paths Ended By Roulette: [{}]", counters[counter::roulette_kills])
+                .c_str());
+            ImGui::Text(
+              "%s",
+              fmt::format(
+                "Passes: [{}], slowest [{:.3f}s]",
+                counters[counter::passes],
+                counters.seconds(counter::slowest_pass_ns))
+                .c_str());
+            ImGui::Text(
+              "%s",
+              fmt::format(
+                "Trace / Shade / Accumulate: [{:.2f}s] / [{:.2f}s] / [{:.2f}s]",
+                counters.seconds(counter::trace_ns),
+                counters.seconds(counter::shade_ns),
+                counters.seconds(counter::accumulate_ns))
+                .c_str());
+            ImGui::TreePop();
+        }
+
         ImGui::Unindent(4.f);
     }
 
@@ -1184,11 +1467,7 @@ namespace cr::ui
             {
                 renderer->update(
                   [scene, transforms = transforms, selected_entity = selected_entity]()
-                  {
-                      scene->registry()
-                        ->entities.get<cr::entity::instances>(selected_entity)
-                        .transforms = transforms;
-                  });
+                  { scene->set_instances(selected_entity, transforms); });
             }
             ImGui::Unindent(4.0f);
             ImGui::EndChild();
@@ -5,7 +5,10 @@
 
 #include <obj_loader/OBJ_Loader.h>
 
+#define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb/stbi_image_write.h>
 
 #define TINYEXR_IMPLEMENTATION
@@ -4,11 +4,6 @@
 #include <util/numbers.h>
 #include <render/entities/components.h>
 
-namespace
-{
-    [[nodiscard]] float randf() noexcept;
-}
-
 namespace cr::sampling
 {
     struct local_coords
@@ -48,6 +43,14 @@ namespace cr::sampling
 
     [[nodiscard]] inline float hemp_cos_pdf(float cos_theta) { return cos_theta / cr::numbers<float>::pi; }
 
+    // Veach's power heuristic (beta = 2), the MIS weight of the strategy that drew the sample
+    [[nodiscard]] inline float power_heuristic(float pdf, float other_pdf)
+    {
+        const auto squared       = pdf * pdf;
+        const auto other_squared = other_pdf * other_pdf;
+        return squared + other_squared > 0.0f ? squared / (squared + other_squared) : 0.0f;
+    }
+
     namespace sun
     {
         [[nodiscard]] inline glm::vec3 sky_colour(const glm::vec3 &direction, const cr::entity::sun &sun)
@@ -56,6 +59,13 @@ namespace cr::sampling
             return (sun_angle < sun.size) ? (sun.colour * sun.intensity) : glm::vec3(0.0f);
         }
 
+        // Solid angle pdf of sample picking the direction, the cone is sampled uniformly
+        [[nodiscard]] inline float pdf(const glm::vec3 &direction, const cr::entity::sun &sun)
+        {
+            const auto sun_angle = glm::acos(glm::dot(direction, -sun.direction));
+            return sun_angle < sun.size ? solid_angle_mapping_pdf(sun.size) : 0.0f;
+        }
+
         struct incoming
         {
             glm::vec3       pos;
@@ -69,11 +79,10 @@ namespace cr::sampling
             float     cosine;
             glm::vec3 dir;
         };
-        [[nodiscard]] inline pdf_cos sample(const incoming& sample)
+        [[nodiscard]] inline pdf_cos sample(const incoming& sample, const glm::vec2 &uv)
         {
             auto out = pdf_cos();
-            out.dir  = sample.sun_transform *
-              map_to_solid_angle(glm::vec2(::randf(), ::randf()), sample.sun.size);
+            out.dir  = sample.sun_transform * map_to_solid_angle(uv, sample.sun.size);
             out.pdf = solid_angle_mapping_pdf(sample.sun.size);
             out.cosine = glm::clamp(glm::dot(sample.normal, out.dir), 0.0f, 1.0f);
             return out;
@@ -139,19 +148,74 @@ namespace cr::sampling
             return glm::vec3(f + f0 * (1.0f - f));
         }
 
+        /**
+         * Specular F (Fresnel), coloured for metals
+         *
+         * F(v,h,f0) = f0 + (1 - f0) (1 - v * h) ^ 5
+         *
+         */
+        [[nodiscard]] inline glm::vec3 specular_f(float u, const glm::vec3 &f0)
+        {
+            return f0 + (glm::vec3(1.0f) - f0) * glm::pow(1.0f - u, 5.0f);
+        }
+
     }    // namespace cook_torrence
 
-    [[nodiscard]] inline glm::vec3 hemp_rand()
+    // Sampling the GGX distribution, alpha is what the cook_torrence terms call roughness
+    namespace ggx
     {
-        while (true)
+        /**
+         * Smith G1 (Masking of one direction)
+         *
+         *                     2 (n * v)
+         * G1(v,a) = ----------------------------------------
+         *           n * v + sqrt(a ^ 2 + (1 - a ^ 2)(n * v) ^ 2)
+         *
+         */
+        [[nodiscard]] inline float smith_g1(float NoV, float alpha)
         {
-            auto point = glm::vec3(::randf() * 2 - 1, ::randf() * 2 - 1, ::randf() * 2 - 1);
+            const auto a2 = alpha * alpha;
+            return 2.0f * NoV / (NoV + glm::sqrt(a2 + (1.0f - a2) * NoV * NoV));
+        }
 
-            if (glm::length(point) >= 1) continue;
+        /*
+         * Heitz 2018, "Sampling the GGX Distribution of Visible Normals". Only normals the view
+         * can see are picked, in proportion to how much of them it sees. view is in the frame of
+         * the surface with the normal along z, so is the half vector returned.
+         */
+        [[nodiscard]] inline glm::vec3
+          visible_normal(const glm::vec3 &view, float alpha, const glm::vec2 &uv)
+        {
+            // Stretched so the distribution becomes a hemisphere
+            const auto stretched =
+              glm::normalize(glm::vec3(alpha * view.x, alpha * view.y, view.z));
+
+            const auto length_sq = stretched.x * stretched.x + stretched.y * stretched.y;
+            const auto t1        = length_sq > 0.0f
+              ? glm::vec3(-stretched.y, stretched.x, 0.0f) / glm::sqrt(length_sq)
+              : glm::vec3(1.0f, 0.0f, 0.0f);
+            const auto t2 = glm::cross(stretched, t1);
+
+            // A disk, squashed where the projected hemisphere hides it from the view
+            const auto r   = glm::sqrt(uv.x);
+            const auto phi = cr::numbers<float>::tau * uv.y;
+            const auto p1  = r * glm::cos(phi);
+            const auto s   = 0.5f * (1.0f + stretched.z);
+            const auto p2  = (1.0f - s) * glm::sqrt(1.0f - p1 * p1) + s * r * glm::sin(phi);
+
+            const auto normal = p1 * t1 + p2 * t2 +
+              glm::sqrt(glm::max(0.0f, 1.0f - p1 * p1 - p2 * p2)) * stretched;
+
+            return glm::normalize(
+              glm::vec3(alpha * normal.x, alpha * normal.y, glm::max(0.0f, normal.z)));
+        }
 
-            return glm::normalize(point);
+        // Solid angle pdf of reflecting the view about a visible_normal sample
+        [[nodiscard]] inline float visible_normal_pdf(float NoV, float NoH, float alpha)
+        {
+            return smith_g1(NoV, alpha) * cook_torrence::specular_d(NoH, alpha) / (4.0f * NoV);
         }
-    }
+    }    // namespace ggx
 
     [[nodiscard]] inline glm::vec3 sphere(const glm::vec2 uv)
     {